@@ -26,6 +26,7 @@ public class ForestGenerator : ModuleRules
 			new string[]
 			{
 				"Core",
+				"ForestGeneratorCore",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -5,10 +5,12 @@
 #include "BranchModule.h"
 
 #include "BranchModuleManager.h"
+#include "BranchModuleTemplate.h"
 #include "DrawDebugHelpers.h"
-#include "BranchNode.h"
-#include "BranchSegment.h"
 #include "ForestGeneratorLog.h"
+#include "GrowthModel.h"
+#include "SimulationCheckpoint.h"
+#include "SpeciesTable.h"
 
 FGraphDefinition UBranchModule::GetGraphDefinition_Implementation()
 {
@@ -16,152 +18,61 @@ FGraphDefinition UBranchModule::GetGraphDefinition_Implementation()
 }
 
 void UBranchModule::Initialize(const FGraphDefinition& NewGraphDefinition, const FVector& InPosition,
-                               UBranchModuleManager* InModuleManager, const FRotator InOrientation)
+                               UBranchModuleManager* InModuleManager, const FRotator InOrientation, const int32 InSeed)
 {
-	ModuleManager = InModuleManager;
-
-	TArray<FGraphEdge> Edges = NewGraphDefinition.Edges;
+	FBranchModuleTemplate Template;
 
-	if (Edges.Num() < 1)
+	if (Template.Compile(NewGraphDefinition.GetEdges()))
 	{
-		UE_LOG(LogForestGenerator, Fatal,
-		       TEXT("Branch Module[%d]: Invalid Definition: Graph must have at least 1 edge."), ID);
-		return;
+		InitializeFromTemplate(Template, InPosition, InModuleManager, InOrientation, InSeed);
 	}
+}
 
-	TSortedMap<int32, UBranchNode*> NodesMap;
-
-	for (const FGraphEdge Edge : Edges)
-	{
-		const int32 SourceID = Edge.Source;
-		const int32 DestinationID = Edge.Destination;
-
-		if (SourceID == DestinationID)
-		{
-			UE_LOG(LogForestGenerator, Fatal,
-			       TEXT("Branch Module[%d]: Invalid Definition: The Source and Destination ID are the same: [%d]."), ID,
-			       SourceID);
-			return;
-		}
-
-		UBranchNode* Source;
-		UBranchNode* Destination;
-
-		if (NodesMap.Find(SourceID) == nullptr)
-		{
-			Source = NewObject<UBranchNode>();
-			Source->SetID(SourceID);
-			NodesMap.Add(SourceID, Source);
-		}
-		else
-		{
-			Source = NodesMap.FindChecked(SourceID);
-		}
-
-		if (NodesMap.Find(DestinationID) == nullptr)
-		{
-			Destination = NewObject<UBranchNode>();
-			Destination->SetID(DestinationID);
-			NodesMap.Add(DestinationID, Destination);
-		}
-		else
-		{
-			Destination = NodesMap.FindChecked(DestinationID);
-		}
-
-		UBranchSegment* Branch = NewObject<UBranchSegment>();
-		Branch->Initialize(Source, Destination);
-
-		Source->AddChildBranch(Branch);
-		Destination->SetParentBranch(Branch);
-
-		// TODO Need to check that the edge being added doesn't exist already
-		Graph.Branches.Add(Branch);
-
-		UE_LOG(LogForestGenerator, Verbose, TEXT("Branch Module[%d]: Edge added from Parent [%d] to Child [%d]"), ID,
-		       SourceID, DestinationID);
-	}
-
-	// Reshuffle IDs so start at 0 and add to graph
-	int32 NextID = 0;
-	for (const TPair<int32, UBranchNode*> Pair : NodesMap)
-	{
-		UBranchNode* Node = Pair.Value;
-		Node->SetID(NextID++);
-		Graph.Nodes.Add(Node);
-	}
-
-	Graph.Root = Graph.Nodes[0];
-	Graph.Root->SetRoot();
-	Graph.Root->Translate(InPosition);
-
-	// We now have an array of nodes all with their edges
-	// Need to check graph is connected now
-	// We will do this by doing a breadth first search of the graph and then checking that all nodes are discovered
-	// Taken from https://en.wikipedia.org/wiki/Breadth-first_search
-	// And the depth calculation is from https://stackoverflow.com/a/43524835
-	TQueue<UBranchNode*> Queue;
-	TArray<int32> Discovered;
-	int32 Depth = 0;
-
-	// Add the root to discovered and the queue
-	UBranchNode* Node = Graph.Nodes[0];
-	Discovered.Add(Node->GetID());
-	Queue.Enqueue(Node);
-	Queue.Enqueue(nullptr);
-
-	while (!Queue.IsEmpty())
-	{
-		if (Queue.Dequeue(Node))
-		{
-			if (Node == nullptr)
-			{
-				Queue.Enqueue(nullptr);
-				if (Queue.Peek() == nullptr || *Queue.Peek() == nullptr)
-				{
-					break;
-				}
-
-				Depth++;
-				continue;
-			}
-			for (UBranchSegment* ChildBranch : Node->GetChildrenBranches())
-			{
-				ChildBranch->SetDepth(Depth);
-				UBranchNode* Child = ChildBranch->GetDestination();
-				if (Discovered.Find(Child->GetID()) == INDEX_NONE)
-				{
-					Discovered.Add(Child->GetID());
-					Queue.Enqueue(Child);
-				}
-			}
-		}
-	}
+void UBranchModule::InitializeFromTemplate(const FBranchModuleTemplate& Template, const FVector& InPosition,
+                                           UBranchModuleManager* InModuleManager, const FRotator InOrientation,
+                                           const int32 InSeed)
+{
+	ModuleManager = InModuleManager;
+	RandomStream.Initialize(InSeed);
 
-	if (Discovered.Num() != Graph.Nodes.Num())
-	{
-		UE_LOG(LogForestGenerator, Fatal, TEXT("Branch Module[%d]: Invalid Definition: The graph is not connected."),
-		       ID);
-	}
+	Graph = Template.Graph;
+	AgeMature = Template.AgeMature;
 
-	// We now have a valid graph!
-	// Minus 1 here as the graph starts with the root and its children
-	AgeMature = static_cast<float>(Depth) - 1;
+	Graph.Translate(FBranchGraph::RootNode, InPosition);
 
 	// Initialize the Branch Module with the root node and its children available
-	for (UBranchSegment* ChildBranch : Graph.Root->GetChildrenBranches())
+	for (int32 i = Graph.FirstChildBranch[FBranchGraph::RootNode]; i < Graph.FirstChildBranch[FBranchGraph::RootNode + 1];
+	     i++)
 	{
-		ChildBranch->MakeAvailable();
-		Graph.AvailableBranches.Add(ChildBranch);
+		Graph.MakeAvailable(Graph.ChildBranches[i]);
 	}
 
-	Graph.Root->SetDirection(InOrientation);
+	Graph.SetDirection(FBranchGraph::RootNode, InOrientation);
 
-	SpawnChildNodes(Graph.Root, 1.f);
+	FGrowthModel::SpawnChildNodes(Graph, FBranchGraph::RootNode, 1.f, RandomStream);
 
 	CalculateBoundingSphere();
 }
 
+void UBranchModule::Reset()
+{
+	Children.Reset();
+	Parent = nullptr;
+	ID = -1;
+	PhysiologicalAge = 0.f;
+	BoundingSphere = FSphere{ForceInit};
+	BoundsProxy = INDEX_NONE;
+	ManagerIndex = INDEX_NONE;
+	bLightExposureDirty = true;
+	CalculatedLightExposure = 0.f;
+	LightExposure = 0.f;
+	Vigor = 0.f;
+	DeltaAge = 0.f;
+	SortMark = ESortMark::None;
+	Orientation = FRotator::ZeroRotator;
+	bShed = false;
+}
+
 void UBranchModule::SetID(const int32 InID)
 {
 	this->ID = InID;
@@ -173,6 +84,11 @@ void UBranchModule::SetVigor(const float InVigor)
 	this->Vigor = InVigor;
 }
 
+void UBranchModule::SetDeltaAge(const float InDeltaAge)
+{
+	DeltaAge = InDeltaAge;
+}
+
 void UBranchModule::ResetSortMark()
 {
 	SortMark = ESortMark::None;
@@ -203,6 +119,11 @@ const TArray<UBranchModule*>& UBranchModule::GetChildren() const
 	return Children;
 }
 
+UBranchModule* UBranchModule::GetParent() const
+{
+	return Parent;
+}
+
 void UBranchModule::DrawBoundingSphere(const UWorld* WorldContext) const
 {
 	if (WorldContext == nullptr)
@@ -221,7 +142,6 @@ void UBranchModule::DrawDebug(const UWorld* WorldContext)
 	}
 
 	// TODO This should call all child module and DrawDebug them as well
-	// Graph.Root->DrawDebug(WorldContext);
 	DrawBoundingSphere(WorldContext);
 }
 
@@ -249,114 +169,57 @@ void UBranchModule::Visit(TArray<UBranchModule*>& SortedNodes)
 	SortedNodes.Add(this);
 }
 
-UBranchNode* UBranchModule::GetRootNode()
-{
-	return Graph.Root;
-}
-
-UBranchModule* UBranchModule::AttachNewBranchModule(UBranchNode* ParentNode, const float ApicalControl,
+UBranchModule* UBranchModule::AttachNewBranchModule(const int32 ParentNode, const float ApicalControl,
                                                     const float Determinacy)
 {
-	const FRotator SpawnOrientation = ParentNode->GetDirection().ToOrientationRotator() -
+	const FRotator SpawnOrientation = Graph.Directions[ParentNode].ToOrientationRotator() -
 		FVector::UpVector.ToOrientationRotator();
 	UBranchModule* ChildModule = ModuleManager->GenerateBranchModule(ApicalControl, Determinacy,
-	                                                                 ParentNode->GetPosition(), SpawnOrientation);
-
-	UBranchSegment* Branch = NewObject<UBranchSegment>();
-	UBranchNode* ChildRootNode = ChildModule->GetRootNode();
+	                                                                 Graph.Positions[ParentNode], SpawnOrientation,
+	                                                                 static_cast<int32>(RandomStream.GetUnsignedInt()));
 
-	Branch->Initialize(ParentNode, ChildRootNode);
-	ParentNode->AddChildBranch(Branch, true);
-	ChildRootNode->SetParentBranch(Branch);
-	Graph.AvailableBranches.Add(Branch);
+	if (Graph.ConnectChildGraph(ParentNode, &ChildModule->Graph))
+	{
+		Graph.AvailableBranches.Add(Graph.GetConnectionBranch(ParentNode));
+	}
 
+	ChildModule->Parent = this;
 	Children.Add(ChildModule);
 	return ChildModule;
 }
 
 void UBranchModule::CalculatePerNodeVigor(const float ApicalControl)
 {
-	// Sort the nodes into a topological order for a basipetal pass
-	TArray<UBranchNode*> SortedNodes = TopologicalSortNodes();
+	FGrowthModel::CalculatePerNodeVigor(Graph, ApicalControl);
+}
 
-	// Accumulate Qu into Qtotal at uroot
-	for (UBranchNode* Node : SortedNodes)
+int32 UBranchModule::Shed()
+{
+	// Detach straight away so nothing reaches the shed modules through the parent again
+	if (Parent != nullptr)
 	{
-		float QU = Node->GetLightExposure();
-
-		// Sum up all Qus
-		for (const UBranchNode* ChildNode : Node->GetChildren())
-		{
-			QU += ChildNode->GetLightExposure();
-		}
-
-		Node->SetLightExposure(QU);
+		Parent->Graph.DisconnectChildGraph(Graph.ParentNode);
+		Parent->Children.Remove(this);
+		Parent = nullptr;
 	}
 
-	// Reverse the list as redistributing in an acropetal pass
-	Algo::Reverse(SortedNodes);
-	ensure(SortedNodes[0] == Graph.Root);
-
-	const float QTotal = Graph.Root->GetLightExposure();
-	Graph.Root->SetVigor(QTotal);
+	// Modules shed before this one were detached then, so everything still attached is shed now
+	int32 NumShed = 0;
+	TArray<UBranchModule*, TInlineAllocator<16>> Subtree{this};
 
-	// Redistribute Vu through plant
-	for (UBranchNode* Node : SortedNodes)
+	while (Subtree.Num() > 0)
 	{
-		const float VU = Node->GetVigor();
-
-		TArray<UBranchNode*> NodeChildren = Node->GetChildren();
+		UBranchModule* Module = Subtree.Pop(false);
 
-		if (NodeChildren.Num() == 1)
+		if (!Module->bShed)
 		{
-			// If the module only has one child, the remaining vigor goes to them
-			UBranchNode* Child = NodeChildren[0];
-			Child->SetVigor(VU);
-		}
-		else if (NodeChildren.Num() > 1)
-		{
-			UBranchNode* MainChild = nullptr;
-
-			for (UBranchNode* Child : NodeChildren)
-			{
-				if (MainChild != nullptr)
-				{
-					MainChild = (Child->GetID() < MainChild->GetID()) ? Child : MainChild;
-				}
-				else
-				{
-					MainChild = Child;
-				}
-			}
-
-			NodeChildren.Remove(MainChild);
-
-			const float QUM = MainChild->GetLightExposure();
-			const float QUL = Node->GetLightExposure() - QUM;
-			const float Lambda = ApicalControl;
-
-			// Eq 2
-			float VUM = 0.f;
-			
-			if (QUM != 0.f)
-			{
-				VUM = VU * (Lambda * QUM) / (Lambda * QUM + (1 - Lambda) * QUL);
-			}
-			const float VUL = VU - VUM;
-
-			MainChild->SetVigor(VUM);
-
-			for (UBranchNode* Child : NodeChildren)
-			{
-				Child->SetVigor(VUL);
-			}
+			Module->bShed = true;
+			NumShed++;
+			Subtree.Append(Module->Children);
 		}
 	}
-}
 
-void UBranchModule::Shed()
-{
-	bShed = true;
+	return NumShed;
 }
 
 bool UBranchModule::IsShed()
@@ -364,20 +227,24 @@ bool UBranchModule::IsShed()
 	return bShed;
 }
 
-void UBranchModule::Grow(const float DT, const float VMin, const float VMax, const float GP,
-                         const float Phi, const float Beta, const float LMax, const float G1,
-                         const float Alpha, const FVector& GDir, const float TropismStrength,
-                         const float Straightness, const float ApicalControl, const float Determinacy,
-                         const bool bCanSpawnChildren)
+bool UBranchModule::Grow(const FSpeciesTable& Species, const int32 SpeciesID, const FVector& GDir,
+                         int32& ModuleBudget)
 {
 	UE_LOG(LogForestGenerator, Log, TEXT("Branch Module[%d]: ========== Main Grow Loop =========="), ID);
+
+	const float VMin = Species.VMin[SpeciesID];
+	const float VMax = Species.VMax[SpeciesID];
+	const float ApicalControl = Species.ApicalControl[SpeciesID];
+	const float Determinacy = Species.Determinacy[SpeciesID];
 	
 	if (Vigor < VMin)
 	{
 		UE_LOG(LogForestGenerator, Log, TEXT("Branch Module[%d]: vigor too low = %f"), ID, Vigor);
-		return;
+		return false;
 	}
 
+	bool bModulesChanged = false;
+
 	// Shuffles the array so not the same order each time
 	if (Children.Num() > 0)
 	{
@@ -391,150 +258,73 @@ void UBranchModule::Grow(const float DT, const float VMin, const float VMax, con
 		// 	}
 		// }
 
-		TArray<UBranchModule*> NewChildren;
-
+		// Shed children have already been detached
 		for (UBranchModule* Child : Children)
 		{
-			if (!Child->IsShed())
-			{
-				NewChildren.Add(Child);
-				Child->Grow(DT, VMin, VMax, GP, Phi, Beta, LMax, G1, Alpha, GDir, TropismStrength, Straightness,
-				            ApicalControl,
-				            Determinacy, bCanSpawnChildren);
-			}
-			else
-			{
-				UBranchSegment* ConnectingBranch = Child->GetRootNode()->GetParentBranch();
-				Graph.AvailableBranches.Remove(ConnectingBranch);
-				ConnectingBranch->GetSource()->ResetToTerminal();
-			}
+			bModulesChanged |= Child->Grow(Species, SpeciesID, GDir, ModuleBudget);
 		}
-		Children = NewChildren;
 	}
 
-	// Smoothly interpolated sigmoid function
-	auto S = [](const float X) { return 3 * FMath::Square(X) - 2 * FMath::Pow(X, 3.f); };
-
 	// Clamp Vigor to VMax
 	Vigor = FMath::Min(Vigor, VMax);
 
-	// ========== Equation 5 ==========
-	// Calculate growth rate (how quickly a module is developed)
-	const float GrowthRate = S((Vigor - VMin) / (VMax - VMin)) * GP;
-
-	// ========== Equation 6 ==========
-	// Calculate the DeltaAge using the rate of change of physiological age function (dau/dt = Y(u))
-	const float DeltaAge = GrowthRate * static_cast<float>(DT);
-
 	// Increase physiological age of branch module and potentially grow graph
-	IncreaseAge(DeltaAge, Straightness);
+	IncreaseAge(Species.Straightness[SpeciesID]);
 
-	if (PhysiologicalAge > AgeMature && bCanSpawnChildren)
+	if (PhysiologicalAge > AgeMature && ModuleBudget > 0)
 	{
-		TArray<UBranchNode*> TerminalNodes = GetTerminalNodes();
+		TArray<int32> TerminalNodes = GetTerminalNodes();
 		if (TerminalNodes.Num() != 0)
 		{
 			const float TerminalLightExposure = LightExposure / static_cast<float>(TerminalNodes.Num());
-			for (UBranchNode* TerminalNode : TerminalNodes)
+			for (const int32 TerminalNode : TerminalNodes)
 			{
-				TerminalNode->SetLightExposure(TerminalLightExposure);
+				Graph.LightExposures[TerminalNode] = TerminalLightExposure;
 			}
 
 			CalculatePerNodeVigor(ApicalControl);
 
-			for (UBranchNode* TerminalNode : TerminalNodes)
+			for (const int32 TerminalNode : TerminalNodes)
 			{
 				UE_LOG(LogForestGenerator, Verbose, TEXT("Branch Module[%d]: Terminal vigor = %f"), ID,
-				       TerminalNode->GetVigor());
-				if (TerminalNode->GetVigor() > VMin && TerminalNode->GetPosition().Z > BoundingSphere.Center.Z)
+				       Graph.Vigors[TerminalNode]);
+				if (ModuleBudget > 0 && Graph.Vigors[TerminalNode] > VMin &&
+					Graph.Positions[TerminalNode].Z > BoundingSphere.Center.Z)
 				{
 					UBranchModule* Child = AttachNewBranchModule(TerminalNode, ApicalControl,
 					                                             Vigor * Determinacy / VMax);
+					ModuleBudget--;
+					bModulesChanged = true;
 					// Child->Grow(DT, VMin, VMax, GP, Phi, Beta, LMax, G1, Alpha, GDir, TropismStrength, Straightness,
-					//             ApicalControl, Determinacy, bCanSpawnChildren);
+					//             ApicalControl, Determinacy, ModuleBudget);
 				}
 			}
 		}
 	}
 
-	TArray<UBranchSegment*> Branches(Graph.AvailableBranches);
-	Algo::Reverse(Branches);
+	FGrowthModel::GrowBranches(Graph, Species.Phi[SpeciesID], Species.Beta[SpeciesID], Species.LMax[SpeciesID],
+	                           Species.G1[SpeciesID], Species.Alpha[SpeciesID], GDir,
+	                           Species.TropismStrength[SpeciesID]);
 
-	for (UBranchSegment* Branch : Branches)
-	{
-		UBranchNode* Node = Branch->GetDestination();
-
-		// In the paper, the age of a branch is defined by = module age - oldest node in the segment age
-		// which doesn't make sense as the beginning branch ages will always be zero, and all other branches will
-		// never age as the difference between the max age and Au will always be the same...
-		// Therefore, after talking with Jian, I think the branch age should be the age of the destination node as
-		// that's when the branch was added
-		const float BranchAge = Node->GetAge();
-
-		// ========== Equation 8 ==========
-		TArray<UBranchSegment*> ChildrenBranches = Node->GetAvailableChildrenBranches();
-
-		if (ChildrenBranches.Num() != 0)
-		{
-			// If the branch has children, set the diameter to sqrt(sum of (children diameter^2) of all children)
-			float SummedChildDiameters = 0.f;
-
-			for (const UBranchSegment* ChildrenBranch : ChildrenBranches)
-			{
-				SummedChildDiameters += FMath::Square(ChildrenBranch->GetDiameter());
-			}
-
-			Branch->SetDiameter(FMath::Sqrt(SummedChildDiameters));
-		}
-		else
-		{
-			// If the branch has no children the diameter is the thickening factor
-			Branch->SetDiameter(Phi);
-		}
-
-		// ========== Equation 9 ==========
-		const float NewBranchLength = FMath::Min(LMax, Beta * BranchAge);
-		const float BranchChange = NewBranchLength - Node->GetParentBranchLength();
-		FVector Growth = BranchChange * Node->GetDirection();
-
-		Node->Translate(Growth);
-
-		// Section 5.3.1 - Module Adaptation
-		// This is where the tropism is used to effect positions of the nodes
-		const float G2 = Alpha * -1.f * TropismStrength;
-		FVector TropismOffset;
-		const float Denominator = BranchAge + G1;
+	CalculateBoundingSphere();
 
-		if (Denominator == 0.f)
-		{
-			TropismOffset = FVector::ZeroVector;
-		}
-		else
-		{
-			TropismOffset = (G1 * GDir * G2) / Denominator;
-		}
+	return bModulesChanged;
+}
 
-		if ((Node->GetPosition() + TropismOffset).Z < 0.f)
-		{
-			TropismOffset.Z = 0.1f - Node->GetPosition().Z;
-		}
+TArray<FBranch> UBranchModule::GetBranchTransforms() const
+{
+	TArray<FBranchSegment> Segments;
+	Graph.GetBranchTransforms(FBranchGraph::RootNode, Segments);
 
-		if (BranchAge < 2.f)
-		{
-			TropismOffset = FVector::ZeroVector;
-		}
+	TArray<FBranch> BranchTransforms;
+	BranchTransforms.Reserve(Segments.Num());
 
-		Node->Translate(TropismOffset);
-		Node->RecalculateDirection();
+	for (const FBranchSegment& Segment : Segments)
+	{
+		BranchTransforms.Emplace(Segment.Start, Segment.End, Segment.Diameter);
 	}
 
-
-	CalculateBoundingSphere();
-}
-
-TArray<FBranch> UBranchModule::GetBranchTransforms() const
-{
-	return Graph.Root->GetBranchTransforms();
+	return BranchTransforms;
 }
 
 void UBranchModule::Orientate(const TArray<FSphere> Neighbors, const FRotator& InitialOrientation)
@@ -568,7 +358,7 @@ void UBranchModule::Orientate(const TArray<FSphere> Neighbors, const FRotator& I
 	Orientation = InitialOrientation;
 }
 
-void UBranchModule::CalculateLightExposure(const TArray<FSphere>& IntersectingNeighbors)
+void UBranchModule::CalculateLightExposure(const FSphereBatch& IntersectingNeighbors)
 {
 	UE_LOG(LogForestGenerator, Log, TEXT("Branch Module[%d]: Calculating light exposure"), ID);
 
@@ -582,8 +372,27 @@ void UBranchModule::CalculateLightExposure(const TArray<FSphere>& IntersectingNe
 	UE_LOG(LogForestGenerator, Verbose, TEXT("Branch Module[%d]: Percent of Branch Module that collides: %f"), ID,
 	       Collisions);
 
-	LightExposure = FMath::Clamp(FMath::Exp(-Collisions), 0.f, 1.f);
+	LightExposure = FGrowthModel::GetLightExposure(Collisions);
 	UE_LOG(LogForestGenerator, Verbose, TEXT("Branch Module[%d]: Calculated light exposure Qu: %f"), ID, LightExposure);
+
+	CalculatedLightExposure = LightExposure;
+	bLightExposureDirty = false;
+}
+
+void UBranchModule::CalculateLightExposure(const float Shadow)
+{
+	UE_LOG(LogForestGenerator, Log, TEXT("Branch Module[%d]: Calculating light exposure from shadow: %f"), ID, Shadow);
+
+	LightExposure = FGrowthModel::GetLightExposure(Shadow);
+	UE_LOG(LogForestGenerator, Verbose, TEXT("Branch Module[%d]: Calculated light exposure Qu: %f"), ID, LightExposure);
+
+	CalculatedLightExposure = LightExposure;
+	bLightExposureDirty = false;
+}
+
+void UBranchModule::ResolveNodePositions()
+{
+	Graph.ResolvePositions(true);
 }
 
 const FSphere& UBranchModule::GetBoundingSphere() const
@@ -617,22 +426,59 @@ float UBranchModule::CalculateCollisions(const FSphere& Sphere, const TArray<FSp
 	return FMath::Max(Collisions, 0.f);
 }
 
+float UBranchModule::CalculateCollisions(const FSphere& Sphere, const FSphereBatch& IntersectingNeighbors)
+{
+	return FMath::Max(IntersectingNeighbors.SumIntersectingVolumes(Sphere), 0.f);
+}
+
 float UBranchModule::CalculateIntersectingVolume(const FSphere& Sphere, const FSphere& Neighbor)
 {
-	// See https://mathworld.wolfram.com/Sphere-SphereIntersection.html
-	const float d = FVector::Distance(Sphere.Center, Neighbor.Center);
-	const float R = Sphere.W;
-	const float r = Neighbor.W;
+	return FGrowthModel::CalculateIntersectingVolume(Sphere, Neighbor);
+}
 
-	// Ensure the spheres are intersecting
-	ensure(d < R + r);
+void UBranchModule::SetBoundsProxy(const int32 InBoundsProxy)
+{
+	BoundsProxy = InBoundsProxy;
+}
 
-	// PI * (R + r - d)^2 * (d^2 + 2dr - 3r^2 + 2dR + 6rR - 3R^2) / 12d
-	return (PI *
-			FMath::Square(R + r - d) *
-			(FMath::Square(d) + 2.f * d * r - 3 * FMath::Square(r) + 2.f * d * R + 6.f * r * R - 3.f *
-				FMath::Square(R))) /
-		(12.f * d);
+int32 UBranchModule::GetBoundsProxy() const
+{
+	return BoundsProxy;
+}
+
+void UBranchModule::SetManagerIndex(const int32 InManagerIndex)
+{
+	ManagerIndex = InManagerIndex;
+}
+
+int32 UBranchModule::GetManagerIndex() const
+{
+	return ManagerIndex;
+}
+
+void UBranchModule::SetTemplateIndex(const int32 InTemplateIndex)
+{
+	TemplateIndex = InTemplateIndex;
+}
+
+int32 UBranchModule::GetTemplateIndex() const
+{
+	return TemplateIndex;
+}
+
+bool UBranchModule::IsLightExposureDirty() const
+{
+	return bLightExposureDirty;
+}
+
+void UBranchModule::MarkLightExposureDirty()
+{
+	bLightExposureDirty = true;
+}
+
+void UBranchModule::RestoreLightExposure()
+{
+	LightExposure = CalculatedLightExposure;
 }
 
 void UBranchModule::CalculateBoundingSphere()
@@ -642,12 +488,16 @@ void UBranchModule::CalculateBoundingSphere()
 	// So in this function we calculate the midpoint by averaging all positions,
 	// then we calculate the max distance of all the positions with the midpoint and use this as the radius.
 
+	// Parent modules don't move their children until after the children have grown, so their positions can be used
+	// as they are and only this module's positions need resolving
+	Graph.ResolvePositions(false);
+
 	TArray<FVector> NodePositions;
 	FVector Midpoint{0.f};
 
-	for (UBranchNode* Node : GetAvailableNodes())
+	for (const int32 Node : GetAvailableNodes())
 	{
-		FVector NodePosition = Node->GetPosition();
+		FVector NodePosition = Graph.Positions[Node];
 		NodePositions.Add(NodePosition);
 		Midpoint += NodePosition;
 	}
@@ -666,122 +516,108 @@ void UBranchModule::CalculateBoundingSphere()
 	// When the branch module is spawned it can have 0 radius so set it to at least something so it doesn't cause issues
 	RadiusSquared = (RadiusSquared == 0.f) ? 10.f : RadiusSquared;
 
-	BoundingSphere = FSphere(Midpoint, FMath::Sqrt(RadiusSquared));
-}
-
-void UBranchModule::SpawnChildNodes(UBranchNode* Parent, const float Straightness) const
-{
-	const FVector ParentPosition = Parent->GetPosition();
-	TArray<UBranchNode*> ChildrenNodes = Parent->GetChildren();
-	Algo::Reverse(ChildrenNodes);
-	UBranchNode* Child;
-
-	const FRotator ParentRotation = Parent->GetDirection().ToOrientationRotator() -
-		FVector::UpVector.ToOrientationRotator();
-	FVector Position = FVector::UpVector;
+	const FSphere NewBoundingSphere{Midpoint, FMath::Sqrt(RadiusSquared)};
 
-	// Children.Num() can be max of 5
-
-	// If there is an odd number of children one child is always straight up
-	if ((ChildrenNodes.Num() + 1) % 2 == 0)
+	// Modules that have stopped growing keep the same bounding sphere, so their light exposure only needs
+	// recalculating if a neighbor changes
+	if (!NewBoundingSphere.Equals(BoundingSphere, 0.f))
 	{
-		const FRotator Rotator = FRotator{
-			FMath::RandRange(-10.f, 10.f),
-			0.f,
-			FMath::RandRange(-10.f, 10.f)
-		} * (1.f - Straightness);
-		Child = ChildrenNodes.Pop();
-		Position = Rotator.RotateVector(Position);
-		Position = ParentRotation.RotateVector(Position);
-		Child->Translate(ParentPosition + Position);
-		Child->RecalculateDirection();
+		BoundingSphere = NewBoundingSphere;
+		bLightExposureDirty = true;
 	}
+}
 
-	if (ChildrenNodes.Num() == 0)
+void UBranchModule::SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap,
+                                        UBranchModuleManager* InModuleManager)
+{
+	if (Ar.IsLoading())
 	{
-		return;
+		ModuleManager = InModuleManager;
 	}
 
-	// This is used to make sure not all the branches come out the same direction for each SpawnChildren call
-	const FRotator Rotator = FRotator{0.f, FMath::RandRange(0.f, 360.f), 0.f};
-
-
-	if (ChildrenNodes.Num() == 4)
+	Ar << ID;
+	Ar << TemplateIndex;
+	Ar << PhysiologicalAge;
+	Ar << AgeMature;
+	Ar << Vigor;
+	Ar << LightExposure;
+	Ar << CalculatedLightExposure;
+	Ar << bLightExposureDirty;
+	Ar << BoundingSphere;
+	Ar << Orientation;
+	Ar << bShed;
+
+	// Starting a new stream from the current seed carries on the same sequence
+	int32 Seed = RandomStream.GetCurrentSeed();
+	Ar << Seed;
+
+	if (Ar.IsLoading())
 	{
-		Child = ChildrenNodes.Pop();
-		Position = FVector{1.f, 0.f, 1.f};
-		Position = Rotator.RotateVector(Position);
-		Position = ParentRotation.RotateVector(Position);
-		Child->Translate(ParentPosition + Position);
-		Child->RecalculateDirection();
-
-		Child = ChildrenNodes.Pop();
-		Position = FVector{-1.f, 0.f, 1.f};
-		Position = Rotator.RotateVector(Position);
-		Position = ParentRotation.RotateVector(Position);
-		Child->Translate(ParentPosition + Position);
-		Child->RecalculateDirection();
+		RandomStream.Initialize(Seed);
 	}
 
-	Child = ChildrenNodes.Pop();
-	Position = FVector{0.f, 1.f, 1.f};
-	Position = Rotator.RotateVector(Position);
-	Position = ParentRotation.RotateVector(Position);
-	Child->Translate(ParentPosition + Position);
-	Child->RecalculateDirection();
-
-	Child = ChildrenNodes.Pop();
-	Position = FVector{0.f, -1.f, 1.f};
-	Position = Rotator.RotateVector(Position);
-	Position = ParentRotation.RotateVector(Position);
-	Child->Translate(ParentPosition + Position);
-	Child->RecalculateDirection();
+	ModuleMap.Serialize(Ar, Children);
+	Ar << Graph;
 }
 
-void UBranchModule::GrowGraph(const float Straightness)
+bool UBranchModule::ReconnectChildGraphs()
 {
-	TArray<UBranchNode*> NewParents;
-	for (UBranchSegment* Branch : Graph.Branches)
+	for (UBranchModule* Child : Children)
 	{
-		if (!Branch->IsAvailable() && Branch->GetDepth() <= static_cast<int>(PhysiologicalAge))
+		// A module attached to two parents, or to itself, would make the plant's modules loop back on themselves
+		if (Child == nullptr || Child == this || Child->Parent != nullptr)
 		{
-			Branch->MakeAvailable();
-			Graph.AvailableBranches.Add(Branch);
-			Branch->GetDestination()->IncreaseAge(PhysiologicalAge - static_cast<float>(Branch->GetDepth()));
+			return false;
+		}
 
-			NewParents.AddUnique(Branch->GetSource());
+		const int32 Node = Child->Graph.ParentNode;
+
+		if (!Graph.Types.IsValidIndex(Node) || !Graph.IsConnecting(Node) || Graph.ChildGraphs[Node] != nullptr ||
+			Child->Graph.GetNumNodes() < 1)
+		{
+			return false;
 		}
+
+		Graph.ChildGraphs[Node] = &Child->Graph;
+		Child->Graph.ParentGraph = &Graph;
+		Child->Parent = this;
 	}
 
-	for (UBranchNode* NewParent : NewParents)
+	// Connecting nodes are followed into their child graph while simulating
+	for (int32 Node = 0; Node < Graph.GetNumNodes(); Node++)
 	{
-		SpawnChildNodes(NewParent, Straightness);
+		if (Graph.IsConnecting(Node) && Graph.ChildGraphs[Node] == nullptr)
+		{
+			return false;
+		}
 	}
+
+	return true;
 }
 
-void UBranchModule::IncreaseAge(const float DeltaAge, const float Straightness)
+void UBranchModule::IncreaseAge(const float Straightness)
 {
 	PhysiologicalAge += DeltaAge;
 
 	UE_LOG(LogForestGenerator, Log, TEXT("Branch Module[%d]: Aging by %f, age now: %f"),
 	       ID, DeltaAge, PhysiologicalAge);
 
-	Graph.Root->IncreaseAge(DeltaAge);
+	Graph.IncreaseAge(FBranchGraph::RootNode, DeltaAge);
 
-	GrowGraph(Straightness);
+	FGrowthModel::GrowGraph(Graph, PhysiologicalAge, Straightness, RandomStream);
 }
 
-TArray<UBranchNode*> UBranchModule::GetAvailableNodes()
+TArray<int32> UBranchModule::GetAvailableNodes() const
 {
-	TArray<UBranchNode*> AvailableNodes;
+	TArray<int32> AvailableNodes;
 
-	for (UBranchNode* Node : Graph.Nodes)
+	for (int32 Node = 0; Node < Graph.GetNumNodes(); Node++)
 	{
-		if (Node->IsRoot())
+		if (Graph.IsRoot(Node))
 		{
 			AvailableNodes.Add(Node);
 		}
-		else if (Node->IsParentBranchAvailable())
+		else if (Graph.IsParentBranchAvailable(Node))
 		{
 			AvailableNodes.Add(Node);
 		}
@@ -790,15 +626,15 @@ TArray<UBranchNode*> UBranchModule::GetAvailableNodes()
 	return AvailableNodes;
 }
 
-TArray<UBranchNode*> UBranchModule::GetTerminalNodes()
+TArray<int32> UBranchModule::GetTerminalNodes()
 {
-	TArray<UBranchNode*> TerminalNodes;
+	TArray<int32> TerminalNodes;
 
-	TArray<UBranchNode*> SortedNodes = TopologicalSortNodes();
+	const TArray<int32>& SortedNodes = TopologicalSortNodes();
 
-	for (UBranchNode* SortedNode: SortedNodes)
+	for (const int32 SortedNode : SortedNodes)
 	{
-		if (SortedNode->IsParentBranchAvailable() && SortedNode->IsTerminal())
+		if (Graph.IsParentBranchAvailable(SortedNode) && Graph.IsTerminal(SortedNode))
 		{
 			TerminalNodes.Add(SortedNode);
 		}
@@ -807,16 +643,7 @@ TArray<UBranchNode*> UBranchModule::GetTerminalNodes()
 	return TerminalNodes;
 }
 
-TArray<UBranchNode*> UBranchModule::TopologicalSortNodes() const
+const TArray<int32>& UBranchModule::TopologicalSortNodes()
 {
-	TArray<UBranchNode*> SortedNodes;
-
-	Graph.Root->Visit(SortedNodes);
-
-	for (UBranchNode* SortedNode : SortedNodes)
-	{
-		SortedNode->ResetSortMark();
-	}
-
-	return SortedNodes;
-}
\ No newline at end of file
+	return Graph.GetSortedNodes();
+}
@@ -3,9 +3,51 @@
 
 #include "BranchModuleManager.h"
 
+#include "Async/ParallelFor.h"
 #include "BranchModule.h"
 #include "ForestGeneratorLog.h"
+#include "SimulationCheckpoint.h"
 
+namespace
+{
+	/**
+	 * @brief How much the bounds of a module are fattened by in the bounds tree, as a ratio of its radius.
+	 * Modules grow slowly so this lets most of them go many steps before having to be reinserted.
+	 */
+	constexpr float BoundsMarginRatio = 0.2f;
+
+	/**
+	 * @brief How many modules each task handles in the parallel light exposure pass.
+	 * Big enough that the scratch arrays are reused a good number of times, small enough to balance across workers.
+	 */
+	constexpr int32 LightExposureBatchSize = 32;
+
+	/**
+	 * @brief Where modules generated or removed on this thread are recorded, nullptr to apply them straight away.
+	 */
+	thread_local FDeferredModuleChanges* DeferredModuleChanges = nullptr;
+
+	FBox GetSphereBounds(const FSphere& Sphere)
+	{
+		return FBox::BuildAABB(Sphere.Center, FVector{Sphere.W});
+	}
+
+	float GetBoundsMargin(const FSphere& Sphere)
+	{
+		return Sphere.W * BoundsMarginRatio;
+	}
+}
+
+FScopedDeferredModuleChanges::FScopedDeferredModuleChanges(FDeferredModuleChanges& Changes)
+	: PreviousChanges(DeferredModuleChanges)
+{
+	DeferredModuleChanges = &Changes;
+}
+
+FScopedDeferredModuleChanges::~FScopedDeferredModuleChanges()
+{
+	DeferredModuleChanges = PreviousChanges;
+}
 
 bool UBranchModuleManager::Initialize(const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes)
 {
@@ -25,44 +67,333 @@ bool UBranchModuleManager::Initialize(const TArray<TSubclassOf<UBranchModule>>&
 	{
 		// TODO when adding a module, decide its morphospace based on average children number and number of nodes
 		UBranchModule* Prototype = NewObject<UBranchModule>(this, BranchModulePrototype);
-		GraphPrototypes.Add(Prototype->GetGraphDefinition());
+		const FGraphDefinition GraphDefinition = Prototype->GetGraphDefinition();
+
+		// Compile the prototype now so spawning a module from it only has to copy the template
+		FBranchModuleTemplate Template;
+
+		if (!Template.Compile(GraphDefinition.GetEdges()))
+		{
+			GraphPrototypes.Reset();
+			ModuleTemplates.Reset();
+			return false;
+		}
+
+		GraphPrototypes.Add(GraphDefinition);
+		ModuleTemplates.Add(MoveTemp(Template));
 	}
 
+	ModulePools.SetNum(ModuleTemplates.Num());
+
 	bInitialized = true;
 	return true;
 }
 
 UBranchModule* UBranchModuleManager::GenerateBranchModule(int32 ApicalControl, int32 Determinacy,
-                                                          const FVector& InPosition, const FRotator& InitialOrientation)
+                                                          const FVector& InPosition, const FRotator& InitialOrientation,
+                                                          const int32 Seed)
 {
 	// TODO Use parameters. For now just return a BranchModule object that uses the first graph prototype
 
-	const FGraphDefinition SelectedGraph = GraphPrototypes[0];
+	const int32 TemplateIndex = 0;
+	const FBranchModuleTemplate& SelectedTemplate = ModuleTemplates[TemplateIndex];
 
-	UBranchModule* NewModule = NewObject<UBranchModule>();
-	NewModule->SetID(NextID);
-	NewModule->Initialize(SelectedGraph, InPosition, this, InitialOrientation);
+	UBranchModule* NewModule = TakePooledModule(TemplateIndex);
+	NewModule->SetTemplateIndex(TemplateIndex);
+	NewModule->SetID(DeferredModuleChanges == nullptr ? NextID : INDEX_NONE);
+	NewModule->InitializeFromTemplate(SelectedTemplate, InPosition, this, InitialOrientation, Seed);
 	// NewModule->Orientate(GetNeighborBoundingSpheres(NewModule), InitialOrientation);
 
+	if (DeferredModuleChanges != nullptr)
+	{
+		DeferredModuleChanges->AddedModules.Add(NewModule);
+		return NewModule;
+	}
+
+	RegisterModule(NewModule);
+
+	return NewModule;
+}
+
+void UBranchModuleManager::RegisterModule(UBranchModule* BranchModule)
+{
+	// Objects created off the game thread are flagged as async, this makes them normal objects again
+	BranchModule->ClearInternalFlags(EInternalObjectFlags::Async);
+	BranchModule->SetID(NextID);
+
 	// Add this to be tracked
-	BranchModules.Add(NewModule);
+	BranchModule->SetManagerIndex(BranchModules.Add(BranchModule));
+
+	// The snapshot is kept the same length as BranchModules so modules can be swapped in to fill gaps
+	const FSphere& BoundingSphere = BranchModule->GetBoundingSphere();
+	BoundingSpheres.Add(BoundingSphere);
+	BranchModule->SetBoundsProxy(BoundsTree.CreateProxy(GetSphereBounds(BoundingSphere),
+	                                                    GetBoundsMargin(BoundingSphere), BranchModule));
 
 	NextID++;
+}
 
-	return NewModule;
+UBranchModule* UBranchModuleManager::TakePooledModule(const int32 TemplateIndex)
+{
+	UBranchModule* PooledModule = nullptr;
+
+	{
+		FScopeLock Lock{&ModulePoolLock};
+		TArray<UBranchModule*>& Pool = ModulePools[TemplateIndex].Modules;
+
+		if (Pool.Num() > 0)
+		{
+			PooledModule = Pool.Pop(false);
+		}
+	}
+
+	if (PooledModule == nullptr)
+	{
+		return NewObject<UBranchModule>();
+	}
+
+	PooledModule->Reset();
+	return PooledModule;
+}
+
+void UBranchModuleManager::PoolModule(UBranchModule* BranchModule)
+{
+	const int32 TemplateIndex = BranchModule->GetTemplateIndex();
+
+	// Modules loaded from a checkpoint made with other prototypes are left for the garbage collector
+	if (ModulePools.IsValidIndex(TemplateIndex))
+	{
+		FScopeLock Lock{&ModulePoolLock};
+		ModulePools[TemplateIndex].Modules.Add(BranchModule);
+	}
+}
+
+void UBranchModuleManager::ApplyDeferredModuleChanges(FDeferredModuleChanges& Changes)
+{
+	for (UBranchModule* BranchModule : Changes.RemovedModules)
+	{
+		RemoveModule(BranchModule);
+	}
+
+	for (UBranchModule* BranchModule : Changes.AddedModules)
+	{
+		RegisterModule(BranchModule);
+	}
+
+	Changes.RemovedModules.Reset();
+	Changes.AddedModules.Reset();
 }
 
 void UBranchModuleManager::CalculateLightExposures()
 {
+	switch (LightExposureModel)
+	{
+	case ELightExposureModel::ShadowPropagation:
+		CalculateShadowPropagationLightExposures();
+		break;
+	default:
+		CalculateSphereIntersectionLightExposures();
+		break;
+	}
+}
+
+void UBranchModuleManager::CalculateSphereIntersectionLightExposures()
+{
+	const int32 NumModules = BranchModules.Num();
+
+	// The snapshot still holds the spheres used in the last pass, in line with BranchModules as removals are mirrored
+	// in it, and the spheres modules added since then were generated with
+	ModulesToRecalculate.Init(bRecalculateAllLightExposures, NumModules);
+
+	TArray<int32> NeighborIndices;
+
+	// A module that has changed affects the modules it used to intersect as well as the ones it intersects now.
+	// Only dirty modules have moved, so everything else is still where it was in the bounds tree
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		if (BranchModules[i]->IsLightExposureDirty())
+		{
+			MarkIntersectingModules(BoundingSpheres[i], NeighborIndices);
+		}
+	}
+
+	// Refit the tree and update the snapshot of the bounding spheres first, so every query this step sees the same
+	// spheres no matter what order the modules are processed in
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		UBranchModule* BranchModule = BranchModules[i];
+
+		if (BranchModule->IsLightExposureDirty() || bRecalculateAllLightExposures)
+		{
+			UpdateBounds(BranchModule);
+			BoundingSpheres[i] = BranchModule->GetBoundingSphere();
+			ModulesToRecalculate[i] = true;
+		}
+	}
+
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		if (BranchModules[i]->IsLightExposureDirty())
+		{
+			MarkIntersectingModules(BoundingSpheres[i], NeighborIndices);
+		}
+	}
+
+	// Everything else would calculate the same light exposure as last time
+	LightExposureQueue.Reset(NumModules);
+
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		if (ModulesToRecalculate[i])
+		{
+			LightExposureQueue.Add(i);
+		}
+		else
+		{
+			BranchModules[i]->RestoreLightExposure();
+		}
+	}
+
+	UE_LOG(LogForestGenerator, Verbose, TEXT("Module Manager: Recalculating %d of %d light exposures"),
+	       LightExposureQueue.Num(), NumModules);
+
+	// Each module only reads the snapshot and the tree and only writes its own light exposure, so they can all be done
+	// at the same time
+	const int32 NumBatches = FMath::DivideAndRoundUp(LightExposureQueue.Num(), LightExposureBatchSize);
+
+	ParallelFor(NumBatches, [this](const int32 BatchIndex)
+	{
+		TArray<int32> NeighborIndices;
+		FSphereBatch NeighborBoundingSpheres;
+
+		const int32 Start = BatchIndex * LightExposureBatchSize;
+		const int32 End = FMath::Min(Start + LightExposureBatchSize, LightExposureQueue.Num());
+
+		for (int32 QueueIndex = Start; QueueIndex < End; QueueIndex++)
+		{
+			const int32 i = LightExposureQueue[QueueIndex];
+			GetNeighborBoundingSpheres(i, NeighborIndices, NeighborBoundingSpheres);
+			BranchModules[i]->CalculateLightExposure(NeighborBoundingSpheres);
+		}
+	}, !bParallelLightExposures);
+
+	bRecalculateAllLightExposures = false;
+}
+
+void UBranchModuleManager::CalculateShadowPropagationLightExposures()
+{
+	// Any change casts shadow on everything below it so the whole grid has to be rebuilt, but if nothing has changed
+	// the light exposures are the same as last time
+	bool bAnyDirty = bRecalculateAllLightExposures;
+
+	for (const UBranchModule* BranchModule : BranchModules)
+	{
+		bAnyDirty |= BranchModule->IsLightExposureDirty();
+	}
+
+	if (!bAnyDirty)
+	{
+		for (UBranchModule* BranchModule : BranchModules)
+		{
+			BranchModule->RestoreLightExposure();
+		}
+
+		return;
+	}
+
+	// The bounds tree isn't needed for the queries here but keep it up to date in case the model is changed
+	BoundingSpheres.Reset(BranchModules.Num());
+
 	for (UBranchModule* BranchModule : BranchModules)
 	{
-		BranchModule->CalculateLightExposure(GetNeighborBoundingSpheres(BranchModule));
+		UpdateBounds(BranchModule);
+		BoundingSpheres.Add(BranchModule->GetBoundingSphere());
+	}
+
+	ShadowGrid.Build(BoundingSpheres, ShadowVoxelSize, ShadowFalloff, !bParallelLightExposures);
+
+	// Sample at the top of each module, the voxels around its center hold its own occupancy and would shade it
+	for (int32 i = 0; i < BranchModules.Num(); i++)
+	{
+		const FSphere& Bounds = BoundingSpheres[i];
+		BranchModules[i]->CalculateLightExposure(ShadowGrid.GetShadow(Bounds.Center + FVector{0.f, 0.f, Bounds.W}));
 	}
+
+	bRecalculateAllLightExposures = false;
 }
 
 void UBranchModuleManager::RemoveModule(UBranchModule* BranchModule)
 {
-	BranchModules.Remove(BranchModule);
+	if (DeferredModuleChanges != nullptr)
+	{
+		DeferredModuleChanges->RemovedModules.Add(BranchModule);
+		return;
+	}
+
+	TArray<UBranchModule*, TInlineAllocator<16>> Subtree{BranchModule};
+	TArray<int32> NeighborIndices;
+
+	while (Subtree.Num() > 0)
+	{
+		UBranchModule* Module = Subtree.Pop(false);
+		const int32 Index = Module->GetManagerIndex();
+
+		// Modules removed before this one took the modules attached to them with them
+		if (!BranchModules.IsValidIndex(Index) || BranchModules[Index] != Module)
+		{
+			continue;
+		}
+
+		// The modules that were intersecting this one will now get more light
+		GetIntersectingModules(BoundingSpheres[Index], NeighborIndices);
+
+		for (const int32 NeighborIndex : NeighborIndices)
+		{
+			BranchModules[NeighborIndex]->MarkLightExposureDirty();
+		}
+
+		// Fill the gap with the last module, keeping the snapshot in line
+		BranchModules.RemoveAtSwap(Index, 1, false);
+		BoundingSpheres.RemoveAtSwap(Index, 1, false);
+
+		if (BranchModules.IsValidIndex(Index))
+		{
+			BranchModules[Index]->SetManagerIndex(Index);
+		}
+
+		// The proxy goes back to the tree's free list to be used by the next module generated
+		BoundsTree.DestroyProxy(Module->GetBoundsProxy());
+		Module->SetBoundsProxy(INDEX_NONE);
+		Module->SetManagerIndex(INDEX_NONE);
+
+		// The module isn't reset until it is taken from the pool, so the plant can still see it has been shed
+		Subtree.Append(Module->GetChildren());
+		PoolModule(Module);
+	}
+
+	// Removing a module uncovers everything below it, not just the modules it was intersecting
+	if (LightExposureModel == ELightExposureModel::ShadowPropagation)
+	{
+		bRecalculateAllLightExposures = true;
+	}
+}
+
+void UBranchModuleManager::SetParallelLightExposures(const bool bInParallelLightExposures)
+{
+	bParallelLightExposures = bInParallelLightExposures;
+}
+
+void UBranchModuleManager::SetLightExposureModel(const ELightExposureModel InLightExposureModel)
+{
+	LightExposureModel = InLightExposureModel;
+	bRecalculateAllLightExposures = true;
+}
+
+void UBranchModuleManager::SetShadowParameters(const float InShadowVoxelSize, const float InShadowFalloff)
+{
+	ShadowVoxelSize = FMath::Max(InShadowVoxelSize, KINDA_SMALL_NUMBER);
+	ShadowFalloff = FMath::Clamp(InShadowFalloff, 0.f, 1.f);
+	bRecalculateAllLightExposures = true;
 }
 
 int UBranchModuleManager::GetNumberOfModules() const
@@ -70,29 +401,124 @@ int UBranchModuleManager::GetNumberOfModules() const
 	return BranchModules.Num();
 }
 
-TArray<FSphere> UBranchModuleManager::GetNeighborBoundingSpheres(UBranchModule* QueryModule) const
+void UBranchModuleManager::Reserve(const int32 NumModules)
 {
-	TArray<FSphere> AllBoundingSpheres;
-	TArray<FSphere> NeighborBoundingSpheres;
-	const FSphere QueryModuleBoundingSphere = QueryModule->GetBoundingSphere();
+	BranchModules.Reserve(NumModules);
+	BoundingSpheres.Reserve(NumModules);
+	LightExposureQueue.Reserve(NumModules);
+	BoundsTree.Reserve(NumModules);
+}
 
-	for (UBranchModule* BranchModule : BranchModules)
+const TArray<UBranchModule*>& UBranchModuleManager::GetBranchModules() const
+{
+	return BranchModules;
+}
+
+void UBranchModuleManager::SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap)
+{
+	Ar << NextID;
+	Ar << bRecalculateAllLightExposures;
+	ModuleMap.Serialize(Ar, BranchModules);
+	Ar << BoundingSpheres;
+
+	// The fattened bounds are kept as they are so the bounds tree finds exactly the same modules after loading
+	TArray<FBox> FatBounds;
+
+	if (Ar.IsSaving())
 	{
-		if (BranchModule != QueryModule)
+		FatBounds.Reserve(BranchModules.Num());
+
+		for (const UBranchModule* BranchModule : BranchModules)
 		{
-			AllBoundingSpheres.Add(BranchModule->GetBoundingSphere());
+			FatBounds.Add(BoundsTree.GetFatBounds(BranchModule->GetBoundsProxy()));
 		}
 	}
 
-	for (FSphere BoundingSphere : AllBoundingSpheres)
+	Ar << FatBounds;
+
+	if (!Ar.IsLoading())
+	{
+		return;
+	}
+
+	BoundsTree.Reset();
+
+	if (Ar.IsError() || FatBounds.Num() != BranchModules.Num() || BoundingSpheres.Num() != BranchModules.Num() ||
+		BranchModules.Contains(nullptr))
+	{
+		Ar.SetError();
+		BranchModules.Reset();
+		BoundingSpheres.Reset();
+		return;
+	}
+
+	for (int32 i = 0; i < BranchModules.Num(); i++)
+	{
+		UBranchModule* BranchModule = BranchModules[i];
+		BranchModule->SetManagerIndex(i);
+		BranchModule->SetBoundsProxy(BoundsTree.CreateProxy(FatBounds[i], 0.f, BranchModule));
+	}
+}
+
+void UBranchModuleManager::GetNeighborBoundingSpheres(const int32 QueryIndex, TArray<int32>& NeighborIndices,
+                                                      FSphereBatch& OutNeighbors) const
+{
+	NeighborIndices.Reset();
+	OutNeighbors.Reset();
+
+	const FSphere& QueryModuleBoundingSphere = BoundingSpheres[QueryIndex];
+
+	BoundsTree.Query(GetSphereBounds(QueryModuleBoundingSphere), [&](const UBranchModule* BranchModule)
 	{
-		if (BoundingSphere.Intersects(QueryModuleBoundingSphere))
+		const int32 NeighborIndex = BranchModule->GetManagerIndex();
+
+		if (NeighborIndex != QueryIndex && BoundingSpheres[NeighborIndex].Intersects(QueryModuleBoundingSphere))
 		{
-			NeighborBoundingSpheres.Add(BoundingSphere);
+			NeighborIndices.Add(NeighborIndex);
 		}
+	});
+
+	// The tree returns modules in no particular order and removals swap modules around, so sort them by ID to keep
+	// the summed collisions deterministic
+	NeighborIndices.Sort([this](const int32 A, const int32 B)
+	{
+		return BranchModules[A]->GetID() < BranchModules[B]->GetID();
+	});
+
+	for (const int32 NeighborIndex : NeighborIndices)
+	{
+		OutNeighbors.Add(BoundingSpheres[NeighborIndex]);
 	}
 
-	UE_LOG(LogForestGenerator, Verbose, TEXT("Module Manager: Neighbors: %d"), NeighborBoundingSpheres.Num());
+	UE_LOG(LogForestGenerator, Verbose, TEXT("Module Manager: Neighbors: %d"), OutNeighbors.Num());
+}
+
+void UBranchModuleManager::GetIntersectingModules(const FSphere& Sphere, TArray<int32>& OutIndices) const
+{
+	OutIndices.Reset();
+
+	BoundsTree.Query(GetSphereBounds(Sphere), [&](const UBranchModule* BranchModule)
+	{
+		if (BranchModule->GetBoundingSphere().Intersects(Sphere))
+		{
+			OutIndices.Add(BranchModule->GetManagerIndex());
+		}
+	});
+}
+
+void UBranchModuleManager::MarkIntersectingModules(const FSphere& Sphere, TArray<int32>& NeighborIndices)
+{
+	GetIntersectingModules(Sphere, NeighborIndices);
+
+	for (const int32 NeighborIndex : NeighborIndices)
+	{
+		ModulesToRecalculate[NeighborIndex] = true;
+	}
+}
 
-	return NeighborBoundingSpheres;
+void UBranchModuleManager::UpdateBounds(UBranchModule* BranchModule)
+{
+	const FSphere& BoundingSphere = BranchModule->GetBoundingSphere();
+	BoundsTree.MoveProxy(BranchModule->GetBoundsProxy(), GetSphereBounds(BoundingSphere),
+	                     GetBoundsMargin(BoundingSphere));
 }
@@ -0,0 +1,162 @@
+// Ollie Nicholls, 2021
+
+
+#include "ForestGeneratorCommandlet.h"
+
+#include "Engine/DataTable.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "UObject/StrongObjectPtr.h"
+
+#include "BranchModule.h"
+#include "Manager.h"
+#include "Plant.h"
+#include "ForestGeneratorLog.h"
+
+UForestGeneratorCommandlet::UForestGeneratorCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+
+	HelpDescription = TEXT("Simulates forests and writes them to disk without a world.");
+	HelpUsage = TEXT("-run=ForestGenerator -PlantTypes=<DataTable> -Prototypes=<Class>[,<Class>...] -Output=<Directory> "
+		"[-Seed=0] [-Count=1] [-Plants=1] [-MaxPlants=100] [-Time=1] [-TimeStep=1] [-Temperature=20] "
+		"[-Precipitation=1392] [-MaxModulesPerPlant=1000] [-MaxModules=100000] [-ShadowPropagation] [-ParallelPlants]. "
+		"Plants are grown from the row named Testing, so the plant types table needs one.");
+}
+
+int32 UForestGeneratorCommandlet::Main(const FString& Params)
+{
+	FString PlantTypesPath;
+	FString PrototypesList;
+	FString OutputDirectory;
+
+	if (!FParse::Value(*Params, TEXT("PlantTypes="), PlantTypesPath) ||
+		!FParse::Value(*Params, TEXT("Prototypes="), PrototypesList, false) ||
+		!FParse::Value(*Params, TEXT("Output="), OutputDirectory))
+	{
+		UE_LOG(LogForestGenerator, Error, TEXT("Commandlet: Missing arguments. Usage: %s"), *HelpUsage);
+		return 1;
+	}
+
+	// Garbage is collected between forests, and nothing else references the plant types and prototypes
+	const TStrongObjectPtr<UDataTable> PlantTypes{LoadObject<UDataTable>(nullptr, *PlantTypesPath)};
+
+	if (!PlantTypes.IsValid())
+	{
+		UE_LOG(LogForestGenerator, Error, TEXT("Commandlet: Couldn't load plant types %s."), *PlantTypesPath);
+		return 1;
+	}
+
+	TArray<FString> PrototypePaths;
+	PrototypesList.ParseIntoArray(PrototypePaths, TEXT(","));
+
+	TArray<TSubclassOf<UBranchModule>> BranchModulePrototypes;
+	TArray<TStrongObjectPtr<UClass>> PrototypeReferences;
+
+	for (const FString& PrototypePath : PrototypePaths)
+	{
+		UClass* Prototype = LoadClass<UBranchModule>(nullptr, *PrototypePath);
+
+		if (Prototype == nullptr)
+		{
+			UE_LOG(LogForestGenerator, Error, TEXT("Commandlet: Couldn't load prototype %s."), *PrototypePath);
+			return 1;
+		}
+
+		BranchModulePrototypes.Add(Prototype);
+		PrototypeReferences.Emplace(Prototype);
+	}
+
+	// The same defaults and limits as the generator, except the time step has to move the simulation on
+	FSimulationSettings Settings;
+	FParse::Value(*Params, TEXT("Plants="), Settings.NumberOfPlants);
+	FParse::Value(*Params, TEXT("MaxPlants="), Settings.MaxNumberOfPlants);
+	FParse::Value(*Params, TEXT("Time="), Settings.Time);
+	FParse::Value(*Params, TEXT("TimeStep="), Settings.TimeStep);
+	FParse::Value(*Params, TEXT("Temperature="), Settings.Temperature);
+	FParse::Value(*Params, TEXT("Precipitation="), Settings.Precipitation);
+	FParse::Value(*Params, TEXT("Seed="), Settings.Seed);
+	FParse::Value(*Params, TEXT("MaxModulesPerPlant="), Settings.MaxModulesPerPlant);
+	FParse::Value(*Params, TEXT("MaxModules="), Settings.MaxModules);
+
+	Settings.NumberOfPlants = FMath::Clamp(Settings.NumberOfPlants, 1, 100);
+	Settings.MaxNumberOfPlants = FMath::Clamp(Settings.MaxNumberOfPlants, 1, 100);
+	Settings.Time = FMath::Clamp(Settings.Time, 1, 10000);
+	Settings.TimeStep = FMath::Clamp(Settings.TimeStep, 1.f, 10000.f);
+	Settings.Temperature = FMath::Clamp(Settings.Temperature, -10.f, 33.f);
+	Settings.Precipitation = FMath::Clamp(Settings.Precipitation, 10.f, 4300.f);
+	Settings.MaxModulesPerPlant = FMath::Max(Settings.MaxModulesPerPlant, 1);
+	Settings.MaxModules = FMath::Max(Settings.MaxModules, 1);
+	Settings.bParallelPlants = FParse::Param(*Params, TEXT("ParallelPlants"));
+	Settings.LightExposureModel = FParse::Param(*Params, TEXT("ShadowPropagation"))
+		                              ? ELightExposureModel::ShadowPropagation
+		                              : ELightExposureModel::SphereIntersection;
+
+	int32 Count = 1;
+	FParse::Value(*Params, TEXT("Count="), Count);
+	Count = FMath::Max(Count, 1);
+
+	const int32 FirstSeed = Settings.Seed;
+	int32 NumFailed = 0;
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		Settings.Seed = FirstSeed + i;
+
+		// A new manager per forest so nothing is kept from the previous one
+		UManager* Manager = NewObject<UManager>();
+		Manager->Simulate(Settings, BranchModulePrototypes, PlantTypes.Get());
+
+		if (Manager->GetPlants().Num() == 0)
+		{
+			UE_LOG(LogForestGenerator, Error,
+			       TEXT("Commandlet: No plants were grown for seed %d, the plant types need a row named Testing."),
+			       Settings.Seed);
+			NumFailed++;
+			continue;
+		}
+
+		const FString Name = OutputDirectory / FString::Printf(TEXT("Forest_%d"), Settings.Seed);
+
+		if (!Manager->SaveCheckpoint(Name + TEXT(".fgcheckpoint")) || !SaveBranches(Manager, Name + TEXT(".csv")))
+		{
+			UE_LOG(LogForestGenerator, Error, TEXT("Commandlet: Couldn't write forest %s."), *Name);
+			NumFailed++;
+			continue;
+		}
+
+		UE_LOG(LogForestGenerator, Display, TEXT("Commandlet: Wrote forest %d of %d to %s."), i + 1, Count, *Name);
+
+		// Forests are independent, so don't let the finished ones build up
+		CollectGarbage(RF_NoFlags);
+	}
+
+	return NumFailed == 0 ? 0 : 1;
+}
+
+bool UForestGeneratorCommandlet::SaveBranches(const UManager* Manager, const FString& Filename)
+{
+	TArray<FString> Lines;
+	Lines.Add(TEXT("Plant,StartX,StartY,StartZ,EndX,EndY,EndZ,Diameter"));
+
+	const TArray<UPlant*>& Plants = Manager->GetPlants();
+
+	for (int32 PlantIndex = 0; PlantIndex < Plants.Num(); PlantIndex++)
+	{
+		if (Plants[PlantIndex]->GetState() == EPlantState::Dead)
+		{
+			continue;
+		}
+
+		for (const FBranch& Branch : Plants[PlantIndex]->GetBranchTransforms())
+		{
+			Lines.Add(FString::Printf(TEXT("%d,%f,%f,%f,%f,%f,%f,%f"), PlantIndex, Branch.Start.X, Branch.Start.Y,
+			                          Branch.Start.Z, Branch.End.X, Branch.End.Y, Branch.End.Z, Branch.Diameter));
+		}
+	}
+
+	return FFileHelper::SaveStringArrayToFile(Lines, *Filename);
+}
@@ -4,6 +4,7 @@
 #include "Generator.h"
 
 #include "Components/BillboardComponent.h"
+#include "Misc/Paths.h"
 
 #include "Manager.h"
 #include "ForestGeneratorLog.h"
@@ -28,8 +29,27 @@ void AGenerator::BeginPlay()
 {
 	Super::BeginPlay();
 	ManagerComponent->SetWorldContext(GetWorld());
-	Simulate();
-	ManagerComponent->Render();
+
+	if (bUseCache && ManagerComponent->LoadFromCache(GetCacheDirectory(), GetSimulationSettings(),
+	                                                 BranchModulePrototypes, PlantTypes))
+	{
+		ManagerComponent->Render();
+		return;
+	}
+
+	switch (SimulationMode)
+	{
+	case ESimulationMode::Async:
+		SimulateAsync();
+		break;
+	case ESimulationMode::TimeSliced:
+		SimulateTimeSliced();
+		break;
+	default:
+		Simulate();
+		OnSimulationFinished(false);
+		break;
+	}
 }
 
 // Called every frame
@@ -39,6 +59,33 @@ void AGenerator::Tick(float DeltaTime)
 }
 
 void AGenerator::Simulate()
+{
+	ManagerComponent->Simulate(GetSimulationSettings(), BranchModulePrototypes, PlantTypes);
+}
+
+void AGenerator::SimulateAsync()
+{
+	ManagerComponent->OnSimulationFinished.AddUniqueDynamic(this, &AGenerator::OnSimulationFinished);
+	ManagerComponent->SimulateAsync(GetSimulationSettings(), BranchModulePrototypes, PlantTypes);
+}
+
+void AGenerator::SimulateTimeSliced()
+{
+	ManagerComponent->OnSimulationFinished.AddUniqueDynamic(this, &AGenerator::OnSimulationFinished);
+	ManagerComponent->SimulateTimeSliced(GetSimulationSettings(), BranchModulePrototypes, PlantTypes);
+}
+
+void AGenerator::CancelSimulation()
+{
+	ManagerComponent->CancelSimulation();
+}
+
+FSimulationProgress AGenerator::GetSimulationProgress() const
+{
+	return ManagerComponent->GetSimulationProgress();
+}
+
+FSimulationSettings AGenerator::GetSimulationSettings()
 {
 	NumberOfPlants = FMath::Clamp(NumberOfPlants, 1, 100);
 	MaxNumberOfPlants = FMath::Clamp(MaxNumberOfPlants, 1, 100);
@@ -46,8 +93,40 @@ void AGenerator::Simulate()
 	TimeStep = FMath::Clamp(TimeStep, 0.f, 10000.f);
 	Temperature = FMath::Clamp(Temperature, -10.f, 33.f);
 	Precipitation = FMath::Clamp(Precipitation, 10.f, 4300.f);
+	TimeSliceBudget = FMath::Max(TimeSliceBudget, 0.f);
+	MaxModulesPerPlant = FMath::Max(MaxModulesPerPlant, 1);
+	MaxModules = FMath::Max(MaxModules, 1);
+
+	FSimulationSettings Settings{NumberOfPlants, MaxNumberOfPlants, Time, TimeStep, Temperature, Precipitation};
+	Settings.Seed = Seed;
+	Settings.MaxModulesPerPlant = MaxModulesPerPlant;
+	Settings.MaxModules = MaxModules;
+	Settings.bParallelLightExposures = bParallelLightExposures;
+	Settings.bParallelPlants = bParallelPlants;
+	Settings.LightExposureModel = LightExposureModel;
+	Settings.ShadowVoxelSize = ShadowVoxelSize;
+	Settings.ShadowFalloff = ShadowFalloff;
+	Settings.TimeSliceBudget = TimeSliceBudget;
+
+	return Settings;
+}
 
-	ManagerComponent->Simulate(FSimulationSettings{
-		                           NumberOfPlants, MaxNumberOfPlants, Time, TimeStep, Temperature, Precipitation
-	                           }, BranchModulePrototypes, PlantTypes);
+void AGenerator::OnSimulationFinished(const bool bCancelled)
+{
+	if (bCancelled)
+	{
+		return;
+	}
+
+	if (bUseCache)
+	{
+		ManagerComponent->SaveToCache(GetCacheDirectory());
+	}
+
+	ManagerComponent->Render();
+}
+
+FString AGenerator::GetCacheDirectory() const
+{
+	return CacheDirectory.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("ForestGenerator") / TEXT("Cache") : CacheDirectory;
 }
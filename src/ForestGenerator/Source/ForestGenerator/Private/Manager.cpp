@@ -3,10 +3,35 @@
 
 #include "Manager.h"
 
+#include "Async/ParallelFor.h"
 #include "BranchModuleManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "SimulationCheckpoint.h"
+#include "UObject/GarbageCollection.h"
 #include "Plant.h"
 #include "ForestGeneratorLog.h"
 
+namespace
+{
+	/**
+	 * @brief The row of the plant types table every plant is grown from.
+	 */
+	const TCHAR* const PlantTypeName = TEXT("Testing");
+
+	/**
+	 * @brief The extension of simulations saved in the cache.
+	 */
+	const TCHAR* const CacheExtension = TEXT(".fgcache");
+
+	/**
+	 * @brief The most modules space is made for when a simulation starts, the module list grows past this as needed.
+	 */
+	constexpr int32 MaxReservedModules = 1 << 18;
+}
+
 // Sets default values for this component's properties
 UManager::UManager()
 {
@@ -26,31 +51,94 @@ void UManager::BeginPlay()
 	// ...
 }
 
+void UManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelSimulation();
+	AsyncSimulation.Wait();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 
 // Called every frame
 void UManager::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// ...
+	if (bTimeSliced && SimulateSlice(SimulationSettings.TimeSliceBudget))
+	{
+		bTimeSliced = false;
+
+		UE_LOG(LogForestGenerator, Log, TEXT("Manager: Time sliced simulation finished after %d steps."),
+		       ProgressStep.GetValue());
+
+		OnSimulationFinished.Broadcast(false);
+	}
+
+	// Hand a finished background simulation back to the game thread
+	if (AsyncSimulation.IsValid() && AsyncSimulation.IsReady())
+	{
+		AsyncSimulation = TFuture<void>();
+
+		UE_LOG(LogForestGenerator, Log, TEXT("Manager: Background simulation %s after %d steps."),
+		       bCancelRequested ? TEXT("cancelled") : TEXT("finished"), ProgressStep.GetValue());
+
+		OnSimulationFinished.Broadcast(bCancelRequested);
+	}
 }
 
 void UManager::Initialize(const FSimulationSettings& Settings,
                           const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
                           UDataTable* PlantTypes)
 {
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't initialize: A simulation is already in progress"));
+		return;
+	}
+
+	SimulationSettings = Settings;
+	SimulatedTime = 0;
+	NextPlant = INDEX_NONE;
+	ProgressStep.Reset();
+	CacheKey = GetCacheKey(Settings, BranchModulePrototypes, PlantTypes);
+
 	ModuleManager = NewObject<UBranchModuleManager>();
 	ModuleManager->Initialize(BranchModulePrototypes);
+	ModuleManager->SetParallelLightExposures(Settings.bParallelLightExposures);
+	ModuleManager->SetLightExposureModel(Settings.LightExposureModel);
+	ModuleManager->SetShadowParameters(Settings.ShadowVoxelSize, Settings.ShadowFalloff);
+
+	// Make room for every module the starting plants can have up front so the simulation doesn't keep reallocating,
+	// within reason as the budgets are only limits
+	const int64 MaxStartingModules = static_cast<int64>(Settings.NumberOfPlants) * Settings.MaxModulesPerPlant;
+	const int32 MaxModules = FMath::Min(Settings.MaxModules, MaxReservedModules);
+	ModuleManager->Reserve(static_cast<int32>(FMath::Min<int64>(MaxStartingModules, MaxModules)));
 
 	// TODO choose a plant type properly. For now just take known plant type
+	Species = MakeShared<FSpeciesTable>();
+	Species->Compile(PlantTypes);
+
 	UE_LOG(LogForestGenerator, Log, TEXT("Manager: Plant types available:"));
-	for (FName PlantName : PlantTypes->GetRowNames())
+	for (const FName& PlantName : Species->Names)
 	{
 		UE_LOG(LogForestGenerator, Log, TEXT(" - %s"), *PlantName.ToString());
 	}
-	const FPlantSettings PlantSettings = *PlantTypes->FindRow<FPlantSettings>("Testing", "");
+
+	const int32 SpeciesID = Species->FindSpecies(PlantTypeName);
 
 	Plants = TArray<UPlant*>();
+
+	if (!Species->IsValidSpecies(SpeciesID))
+	{
+		UE_LOG(LogForestGenerator, Error, TEXT("Manager: No plant type named %s."), PlantTypeName);
+		UpdateProgress();
+		return;
+	}
+
+	// Each plant gets its own stream so the plants don't depend on the order they are simulated in
+	FRandomStream PlantSeeds{Settings.Seed};
+
 	for (int32 i = 0; i < Settings.NumberOfPlants; i++)
 	{
 		// Choose random position TODO this would need an initial seeding then operate on plants reproducing
@@ -60,43 +148,622 @@ void UManager::Initialize(const FSimulationSettings& Settings,
 		UPlant* NewPlant = NewObject<UPlant>();
 
 		// Set parameters on plant
-		NewPlant->Initialize(ModuleManager, Position, PlantSettings);
+		NewPlant->Initialize(ModuleManager, Position, *Species, SpeciesID,
+		                     static_cast<int32>(PlantSeeds.GetUnsignedInt()));
 
 		// Add new plant to array so we can keep track of it in our sim loops
 		Plants.Add(NewPlant);
 	}
+
+	UpdateProgress();
 }
 
 void UManager::Simulate(const FSimulationSettings& Settings,
                         const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
                         UDataTable* PlantTypes)
 {
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't simulate: A simulation is already in progress"));
+		return;
+	}
+
+	Initialize(Settings, BranchModulePrototypes, PlantTypes);
+	RunSimulation(ESimulationMode::Blocking);
+}
+
+void UManager::SimulateAsync(const FSimulationSettings& Settings,
+                             const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+                             UDataTable* PlantTypes)
+{
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't simulate: A simulation is already in progress"));
+		return;
+	}
+
+	// Everything is created on the game thread so the worker only has to create the modules the plants grow
 	Initialize(Settings, BranchModulePrototypes, PlantTypes);
+	RunSimulation(ESimulationMode::Async);
+}
+
+void UManager::SimulateTimeSliced(const FSimulationSettings& Settings,
+                                  const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+                                  UDataTable* PlantTypes)
+{
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't simulate: A simulation is already in progress"));
+		return;
+	}
+
+	Initialize(Settings, BranchModulePrototypes, PlantTypes);
+	RunSimulation(ESimulationMode::TimeSliced);
+}
+
+void UManager::ResumeSimulation(const int32 Time, const ESimulationMode Mode)
+{
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't resume: A simulation is already in progress"));
+		return;
+	}
 
-	for (int32 i = 0; i < Settings.Time; i += Settings.TimeStep)
+	if (ModuleManager == nullptr)
 	{
-		TArray<UPlant*> Temp;
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't resume: No simulation to resume"));
+		return;
+	}
 
-		// The module manager keeps track of all modules and calculates all light exposures as each module needs to
-		// know what its neighbors are
-		ModuleManager->CalculateLightExposures();
+	SimulationSettings.Time = Time;
+	UpdateProgress();
+	RunSimulation(Mode);
+}
 
-		for (UPlant* Plant : Plants)
+void UManager::RunSimulation(const ESimulationMode Mode)
+{
+	switch (Mode)
+	{
+	case ESimulationMode::Async:
+		bCancelRequested = false;
+
+		AsyncSimulation = Async(EAsyncExecution::Thread, [this]()
 		{
-			Plant->Simulate(Settings.TimeStep);
+			{
+				FGCScopeGuard GCGuard;
+				FinishStep();
+			}
 
-			if (Plant->GetState() != EPlantState::Dead)
+			while (!bCancelRequested && !IsSimulationComplete())
 			{
-				Temp.Add(Plant);
+				// Garbage collection waits for the step to finish as new modules are not referenced by anything until
+				// the module manager registers them
+				FGCScopeGuard GCGuard;
+				SimulateStep();
 			}
+		});
+		break;
+	case ESimulationMode::TimeSliced:
+		bTimeSliced = true;
+		break;
+	default:
+		FinishStep();
+
+		while (!IsSimulationComplete())
+		{
+			SimulateStep();
+		}
+		break;
+	}
+}
+
+bool UManager::SaveCheckpoint(const FString& Filename)
+{
+	TArray<uint8> Data;
+
+	if (!SaveCheckpointToMemory(Data))
+	{
+		return false;
+	}
+
+	if (!FFileHelper::SaveArrayToFile(Data, *Filename))
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't save checkpoint: Failed to write %s"), *Filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool UManager::LoadCheckpoint(const FString& Filename,
+                              const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes)
+{
+	TArray<uint8> Data;
+
+	if (!FFileHelper::LoadFileToArray(Data, *Filename))
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't load checkpoint: Failed to read %s"), *Filename);
+		return false;
+	}
+
+	return LoadCheckpointFromMemory(Data, BranchModulePrototypes);
+}
+
+bool UManager::SaveCheckpointToMemory(TArray<uint8>& OutData)
+{
+	if (IsSimulatingAsync() || ModuleManager == nullptr)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't save checkpoint: No simulation or simulating"));
+		return false;
+	}
+
+	// Every module registered with the module manager is saved once and referred to by index, the plants' modules are
+	// all registered so adding their roots only finds modules already in the map
+	FCheckpointModuleMap ModuleMap;
+
+	for (UBranchModule* BranchModule : ModuleManager->GetBranchModules())
+	{
+		ModuleMap.AddWithChildren(BranchModule);
+	}
+
+	for (UPlant* Plant : Plants)
+	{
+		ModuleMap.AddWithChildren(Plant->GetRoot());
+	}
+
+	OutData.Reset();
+	FMemoryWriter Ar{OutData};
+
+	uint32 Magic = FCheckpointModuleMap::Magic;
+	int32 Version = FCheckpointModuleMap::Version;
+	int32 Step = ProgressStep.GetValue();
+	int32 NumModules = ModuleMap.Modules.Num();
+	int32 NumPlants = Plants.Num();
+
+	Ar << Magic << Version;
+	Ar << SimulationSettings << SimulatedTime << NextPlant << Step;
+	Ar << NumModules;
+
+	for (UBranchModule* BranchModule : ModuleMap.Modules)
+	{
+		BranchModule->SerializeCheckpoint(Ar, ModuleMap, ModuleManager);
+	}
+
+	ModuleManager->SerializeCheckpoint(Ar, ModuleMap);
+
+	// The plants only keep their species ID, so the table they index goes first
+	Ar << *Species;
+	Ar << NumPlants;
+
+	for (UPlant* Plant : Plants)
+	{
+		Plant->SerializeCheckpoint(Ar, ModuleMap, ModuleManager, *Species);
+	}
+
+	Ar << PlantModuleBudgets;
+
+	UE_LOG(LogForestGenerator, Log, TEXT("Manager: Saved checkpoint of %d plants and %d modules in %d bytes"),
+	       NumPlants, NumModules, OutData.Num());
+
+	return !Ar.IsError();
+}
+
+bool UManager::LoadCheckpointFromMemory(const TArray<uint8>& Data,
+                                        const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes)
+{
+	if (IsSimulating())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't load checkpoint: A simulation is in progress"));
+		return false;
+	}
+
+	FMemoryReader Ar{Data};
+
+	uint32 Magic = 0;
+	int32 Version = 0;
+	Ar << Magic << Version;
+
+	if (Magic != FCheckpointModuleMap::Magic || Version != FCheckpointModuleMap::Version)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't load checkpoint: Not a checkpoint or out of date"));
+		return false;
+	}
+
+	// Everything is loaded into new objects so a bad checkpoint leaves the current simulation alone
+	FSimulationSettings Settings;
+	int32 Time = 0;
+	int32 Plant = INDEX_NONE;
+	int32 Step = 0;
+	int32 NumModules = 0;
+	Ar << Settings << Time << Plant << Step << NumModules;
+
+	// Every module takes up more than a byte so this stops a corrupt count allocating everything
+	if (Ar.IsError() || NumModules < 0 || NumModules > Data.Num())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't load checkpoint: Corrupt header"));
+		return false;
+	}
+
+	UBranchModuleManager* NewModuleManager = NewObject<UBranchModuleManager>();
+
+	if (!NewModuleManager->Initialize(BranchModulePrototypes))
+	{
+		return false;
+	}
+
+	NewModuleManager->SetParallelLightExposures(Settings.bParallelLightExposures);
+	NewModuleManager->SetLightExposureModel(Settings.LightExposureModel);
+	NewModuleManager->SetShadowParameters(Settings.ShadowVoxelSize, Settings.ShadowFalloff);
+
+	FCheckpointModuleMap ModuleMap;
+	ModuleMap.Modules.Reserve(NumModules);
+
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		ModuleMap.Modules.Add(NewObject<UBranchModule>());
+	}
+
+	for (UBranchModule* BranchModule : ModuleMap.Modules)
+	{
+		BranchModule->SerializeCheckpoint(Ar, ModuleMap, NewModuleManager);
+	}
+
+	bool bConnected = !Ar.IsError();
+
+	for (int32 i = 0; i < NumModules && bConnected; i++)
+	{
+		bConnected = ModuleMap.Modules[i]->ReconnectChildGraphs();
+	}
+
+	NewModuleManager->SerializeCheckpoint(Ar, ModuleMap);
+
+	TSharedPtr<FSpeciesTable> NewSpecies = MakeShared<FSpeciesTable>();
+	Ar << *NewSpecies;
+
+	int32 NumPlants = 0;
+	Ar << NumPlants;
+
+	TArray<UPlant*> NewPlants;
+
+	if (!Ar.IsError() && NumPlants >= 0 && NumPlants <= Data.Num())
+	{
+		for (int32 i = 0; i < NumPlants; i++)
+		{
+			UPlant* NewPlant = NewObject<UPlant>();
+			NewPlant->SerializeCheckpoint(Ar, ModuleMap, NewModuleManager, *NewSpecies);
+			NewPlants.Add(NewPlant);
+		}
+	}
+
+	TArray<int32> NewPlantModuleBudgets;
+	Ar << NewPlantModuleBudgets;
+
+	// The budgets are only used part way through a step
+	bool bValidBudgets = Plant == INDEX_NONE || NewPlantModuleBudgets.Num() == NumPlants;
+
+	for (const int32 PlantModuleBudget : NewPlantModuleBudgets)
+	{
+		bValidBudgets &= PlantModuleBudget >= 0;
+	}
+
+	if (Ar.IsError() || !bConnected || NewPlants.Num() != NumPlants || Plant < INDEX_NONE || Plant > NumPlants ||
+		!bValidBudgets)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't load checkpoint: Corrupt data"));
+		return false;
+	}
+
+	SimulationSettings = Settings;
+	SimulatedTime = Time;
+	NextPlant = Plant;
+	ProgressStep.Set(Step);
+	ModuleManager = NewModuleManager;
+	Species = NewSpecies;
+	Plants = NewPlants;
+	PlantModuleBudgets = NewPlantModuleBudgets;
+	UpdateProgress();
+
+	UE_LOG(LogForestGenerator, Log, TEXT("Manager: Loaded checkpoint of %d plants and %d modules at time %d"),
+	       NumPlants, NumModules, SimulatedTime);
+
+	return true;
+}
+
+bool UManager::SimulateSlice(const float Budget)
+{
+	const double EndTime = FPlatformTime::Seconds() + Budget / 1000.0;
+	bool bSimulatedPlant = false;
+
+	while (!IsSimulationComplete())
+	{
+		// Starting and ending a step take time too, so check the budget before those as well as before each plant
+		if (bSimulatedPlant && FPlatformTime::Seconds() >= EndTime)
+		{
+			break;
+		}
+
+		if (NextPlant == INDEX_NONE)
+		{
+			BeginStep();
+		}
+		else if (NextPlant < Plants.Num())
+		{
+			SimulateNextPlant();
+			bSimulatedPlant = true;
+		}
+		else
+		{
+			EndStep();
 		}
+	}
+
+	return IsSimulationComplete();
+}
+
+void UManager::CancelSimulation()
+{
+	if (bTimeSliced)
+	{
+		bTimeSliced = false;
+		OnSimulationFinished.Broadcast(true);
+	}
+
+	if (IsSimulatingAsync())
+	{
+		bCancelRequested = true;
+	}
+}
+
+bool UManager::IsSimulating() const
+{
+	return bTimeSliced || IsSimulatingAsync();
+}
+
+bool UManager::IsSimulatingAsync() const
+{
+	return AsyncSimulation.IsValid();
+}
+
+FSimulationProgress UManager::GetSimulationProgress() const
+{
+	FSimulationProgress Progress;
+	Progress.Step = ProgressStep.GetValue();
+	Progress.SimulatedTime = ProgressSimulatedTime.GetValue();
+	Progress.Time = SimulationSettings.Time;
+	Progress.NumberOfPlants = ProgressNumberOfPlants.GetValue();
+	Progress.NumberOfModules = ProgressNumberOfModules.GetValue();
+	return Progress;
+}
+
+const TArray<UPlant*>& UManager::GetPlants() const
+{
+	return Plants;
+}
+
+bool UManager::IsSimulationComplete() const
+{
+	return SimulatedTime >= SimulationSettings.Time;
+}
+
+void UManager::SimulateStep()
+{
+	BeginStep();
+	SimulatePlants(SimulationSettings.TimeStep, SimulationSettings.bParallelPlants);
+	EndStep();
+}
+
+void UManager::BeginStep()
+{
+	// The module manager keeps track of all modules and calculates all light exposures as each module needs to
+	// know what its neighbors are
+	ModuleManager->CalculateLightExposures();
+
+	CalculateModuleBudgets();
+
+	NextPlant = 0;
+}
+
+void UManager::CalculateModuleBudgets()
+{
+	const int32 NumPlants = Plants.Num();
+	const int32 ForestModuleBudget = FMath::Max(SimulationSettings.MaxModules - ModuleManager->GetNumberOfModules(), 0);
 
-		Plants = Temp;
+	PlantModuleBudgets.SetNumUninitialized(NumPlants);
+
+	for (int32 PlantIndex = 0; PlantIndex < NumPlants; PlantIndex++)
+	{
+		// The remainder goes to the first plants
+		const int32 Share = ForestModuleBudget / NumPlants + (PlantIndex < ForestModuleBudget % NumPlants ? 1 : 0);
+		const int32 PlantModules = Plants[PlantIndex]->GetNumberOfModules();
+
+		PlantModuleBudgets[PlantIndex] = FMath::Clamp(SimulationSettings.MaxModulesPerPlant - PlantModules, 0, Share);
 	}
 }
 
+void UManager::SimulateNextPlant()
+{
+	if (SimulationSettings.bParallelPlants && NextPlant == 0)
+	{
+		// Parallel plants are simulated all together as a single slice
+		SimulatePlants(SimulationSettings.TimeStep, true);
+		NextPlant = Plants.Num();
+	}
+	else
+	{
+		Plants[NextPlant]->Simulate(SimulationSettings.TimeStep, PlantModuleBudgets[NextPlant]);
+		NextPlant++;
+	}
+}
+
+void UManager::FinishStep()
+{
+	if (NextPlant == INDEX_NONE)
+	{
+		return;
+	}
+
+	// The plants before NextPlant have already been simulated this step, starting a new step would simulate them
+	// twice
+	while (NextPlant < Plants.Num())
+	{
+		SimulateNextPlant();
+	}
+
+	EndStep();
+}
+
+void UManager::EndStep()
+{
+	TArray<UPlant*> Temp;
+
+	for (UPlant* Plant : Plants)
+	{
+		if (Plant->GetState() != EPlantState::Dead)
+		{
+			Temp.Add(Plant);
+		}
+	}
+
+	Plants = Temp;
+
+	NextPlant = INDEX_NONE;
+	SimulatedTime += SimulationSettings.TimeStep;
+	ProgressStep.Increment();
+	UpdateProgress();
+}
+
+void UManager::UpdateProgress()
+{
+	ProgressSimulatedTime.Set(SimulatedTime);
+	ProgressNumberOfPlants.Set(Plants.Num());
+	ProgressNumberOfModules.Set(ModuleManager->GetNumberOfModules());
+}
+
+void UManager::SimulatePlants(const float TimeStep, const bool bParallel)
+{
+	if (bParallel)
+	{
+		// Each plant only touches its own modules, apart from generating and removing modules through the module
+		// manager, so those are recorded per plant and applied afterwards in plant order.
+		// Garbage collection only runs on the game thread, which waits here until every plant is done.
+		TArray<FDeferredModuleChanges> ModuleChanges;
+		ModuleChanges.SetNum(Plants.Num());
+
+		ParallelFor(Plants.Num(), [this, &ModuleChanges, TimeStep](const int32 PlantIndex)
+		{
+			FScopedDeferredModuleChanges DeferredChanges{ModuleChanges[PlantIndex]};
+			Plants[PlantIndex]->Simulate(TimeStep, PlantModuleBudgets[PlantIndex]);
+		});
+
+		for (FDeferredModuleChanges& PlantModuleChanges : ModuleChanges)
+		{
+			ModuleManager->ApplyDeferredModuleChanges(PlantModuleChanges);
+		}
+	}
+	else
+	{
+		for (int32 PlantIndex = 0; PlantIndex < Plants.Num(); PlantIndex++)
+		{
+			Plants[PlantIndex]->Simulate(TimeStep, PlantModuleBudgets[PlantIndex]);
+		}
+	}
+}
+
+FString UManager::GetCacheKey(const FSimulationSettings& Settings,
+                              const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+                              UDataTable* PlantTypes)
+{
+	TArray<uint8> Inputs;
+	FMemoryWriter Ar{Inputs};
+
+	// Everything that changes the forest that is grown, and nothing that only changes how it is simulated
+	int32 Version = FCheckpointModuleMap::Version;
+	FSimulationSettings KeySettings = Settings;
+	Ar << Version;
+	Ar << KeySettings.NumberOfPlants << KeySettings.MaxNumberOfPlants << KeySettings.Time << KeySettings.TimeStep;
+	Ar << KeySettings.Temperature << KeySettings.Precipitation << KeySettings.Seed;
+	Ar << KeySettings.LightExposureModel << KeySettings.ShadowVoxelSize << KeySettings.ShadowFalloff;
+	Ar << KeySettings.MaxModulesPerPlant << KeySettings.MaxModules;
+
+	for (const TSubclassOf<UBranchModule>& BranchModulePrototype : BranchModulePrototypes)
+	{
+		UBranchModule* Prototype = NewObject<UBranchModule>(GetTransientPackage(), BranchModulePrototype);
+		FGraphDefinition GraphDefinition = Prototype->GetGraphDefinition();
+
+		for (FGraphEdge& Edge : GraphDefinition.Edges)
+		{
+			Ar << Edge.Source << Edge.Destination;
+		}
+
+		// Separates the prototypes so different splits of the same edges don't give the same key
+		int32 NumEdges = GraphDefinition.Edges.Num();
+		Ar << NumEdges;
+	}
+
+	const FPlantSettings* PlantSettings = PlantTypes != nullptr
+		                                      ? PlantTypes->FindRow<FPlantSettings>(PlantTypeName, "", false)
+		                                      : nullptr;
+
+	if (PlantSettings != nullptr)
+	{
+		FPlantSettings KeyPlantSettings = *PlantSettings;
+		Ar << KeyPlantSettings;
+	}
+
+	const uint64 Hash = CityHash64(reinterpret_cast<const char*>(Inputs.GetData()), Inputs.Num());
+	return FString::Printf(TEXT("%016llx"), Hash);
+}
+
+bool UManager::LoadFromCache(const FString& CacheDirectory, const FSimulationSettings& Settings,
+                             const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+                             UDataTable* PlantTypes)
+{
+	const FString Key = GetCacheKey(Settings, BranchModulePrototypes, PlantTypes);
+	const FString Filename = CacheDirectory / Key + CacheExtension;
+
+	TArray<uint8> Data;
+
+	if (!FFileHelper::LoadFileToArray(Data, *Filename) || !LoadCheckpointFromMemory(Data, BranchModulePrototypes))
+	{
+		UE_LOG(LogForestGenerator, Log, TEXT("Manager: No cached simulation for %s"), *Key);
+		return false;
+	}
+
+	if (!IsSimulationComplete())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Cached simulation for %s is unfinished, resuming it"), *Key);
+		RunSimulation(ESimulationMode::Blocking);
+	}
+
+	// Take the settings that only change how the simulation runs from the caller
+	SimulationSettings = Settings;
+	ModuleManager->SetParallelLightExposures(Settings.bParallelLightExposures);
+	CacheKey = Key;
+
+	UE_LOG(LogForestGenerator, Log, TEXT("Manager: Loaded cached simulation %s"), *Key);
+	return true;
+}
+
+bool UManager::SaveToCache(const FString& CacheDirectory)
+{
+	if (CacheKey.IsEmpty() || !IsSimulationComplete())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't cache: No finished simulation"));
+		return false;
+	}
+
+	return SaveCheckpoint(CacheDirectory / CacheKey + CacheExtension);
+}
+
 void UManager::Render()
 {
+	// The background simulation is still changing the plants, time sliced ones are only changed between frames
+	if (IsSimulatingAsync())
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't render: A simulation is in progress"));
+		return;
+	}
+
 	if (!WorldContext)
 	{
 		UE_LOG(LogForestGenerator, Warning, TEXT("Manager: Can't render: World Context not available"));
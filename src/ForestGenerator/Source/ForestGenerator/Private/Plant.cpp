@@ -6,10 +6,13 @@
 #include "BranchModule.h"
 #include "BranchModuleManager.h"
 #include "ForestGeneratorLog.h"
+#include "GrowthModel.h"
+#include "SimulationCheckpoint.h"
+#include "SpeciesTable.h"
 
 
 bool UPlant::Initialize(UBranchModuleManager* InModuleManager, const FVector& InPosition,
-                        const FPlantSettings& InSettings)
+                        const FSpeciesTable& InSpecies, const int32 InSpeciesID, const int32 Seed)
 {
 	if (bInitialized)
 	{
@@ -17,37 +20,25 @@ bool UPlant::Initialize(UBranchModuleManager* InModuleManager, const FVector& In
 		return false;
 	}
 
-	BranchModuleManager = InModuleManager;
-	Position = InPosition;
-
-	Settings.PMax = FMath::Max(InSettings.PMax, 0);
-	Settings.VRootMax = FMath::Max(InSettings.VRootMax, 0.f);
-	Settings.Gp = FMath::Max(InSettings.Gp, 0.f);
-	Settings.ApicalControl = FMath::Clamp(InSettings.ApicalControl, 0.f, 1.f);
-	Settings.ApicalControlMature = FMath::Clamp(InSettings.ApicalControlMature, 0.f, 1.f);
-	Settings.Determinacy = FMath::Clamp(InSettings.Determinacy, 0.f, 1.f);
-	Settings.DeterminacyMature = FMath::Clamp(InSettings.DeterminacyMature, 0.f, 1.f);
-	Settings.FAge = FMath::Max(InSettings.FAge, 0);
-	Settings.Alpha = FMath::Clamp(InSettings.Alpha, -1.f, 1.f);
-	Settings.W2 = FMath::Clamp(InSettings.W2, 0.f, 1.f);
-	Settings.G1 = FMath::Clamp(InSettings.G1, -5.f, 5.f);
-	Settings.Phi = FMath::Max(InSettings.Phi, 0.f);
-	Settings.Beta = FMath::Max(InSettings.Beta, 0.f);
-	Settings.VMin = FMath::Max(InSettings.VMin, 0.f);
-	Settings.VMax = FMath::Max(InSettings.VMax, 0.f);
-	Settings.LMax = FMath::Max(InSettings.LMax, 0.f);
-	Settings.TropismStrength = FMath::Max(InSettings.TropismStrength, 0.f);
-	Settings.Straightness = FMath::Clamp(InSettings.Straightness, 0.f, 1.f);
-
-	if (Settings.VMax <= Settings.VMin)
+	if (!InSpecies.IsValidSpecies(InSpeciesID))
 	{
-		Settings.VMax = Settings.VMin + .1f;
+		UE_LOG(LogForestGenerator, Warning, TEXT("Plant: Cannot initialize with unknown species %d."), InSpeciesID);
+		return false;
 	}
 
+	BranchModuleManager = InModuleManager;
+	Position = InPosition;
+	Species = &InSpecies;
+	SpeciesID = InSpeciesID;
+	VRootMax = Species->VRootMax[SpeciesID];
+	RandomStream.Initialize(Seed);
+
 	// Add the root module
 	UBranchModule* BranchModule0 = BranchModuleManager->GenerateBranchModule(
-		Settings.ApicalControl, Settings.Determinacy, Position);
+		Species->ApicalControl[SpeciesID], Species->Determinacy[SpeciesID], Position, FRotator::ZeroRotator,
+		static_cast<int32>(RandomStream.GetUnsignedInt()));
 	Root = BranchModule0;
+	NumberOfModules = 1;
 
 	bInitialized = true;
 	return true;
@@ -58,14 +49,19 @@ EPlantState UPlant::GetState() const
 	return State;
 }
 
-void UPlant::ShedModules(TArray<UBranchModule*> Modules)
+void UPlant::ShedModules(const TArray<UBranchModule*>& Modules)
 {
+	const float VMin = Species->VMin[SpeciesID];
+
 	for (UBranchModule* Module : Modules)
 	{
-		if (Module->GetAge() > 2.f && Module->GetVigor() < Settings.VMin)
+		if (!Module->IsShed() && Module->GetAge() > 2.f && Module->GetVigor() < VMin)
 		{
+			// The whole subtree goes, the modules attached to this one can't get any vigor without it
+			NumberOfModules -= Module->Shed();
 			BranchModuleManager->RemoveModule(Module);
-			Module->Shed();
+			bSortedModulesDirty = true;
+
 			if (Root == Module)
 			{
 				Root = nullptr;
@@ -75,14 +71,19 @@ void UPlant::ShedModules(TArray<UBranchModule*> Modules)
 	}
 }
 
-void UPlant::Simulate(const float TimeStep)
+void UPlant::Simulate(const float TimeStep, const int32 ModuleBudget)
 {
 	// Modules should have light exposures pre calculated before this
-	CalculateVigor();
-	Grow(TimeStep);
+	CalculateVigor(TimeStep);
+	Grow(ModuleBudget);
 	PT += TimeStep;
 }
 
+int32 UPlant::GetNumberOfModules() const
+{
+	return NumberOfModules;
+}
+
 void UPlant::DrawDebug(const UWorld* WorldContext) const
 {
 	Root->DrawDebug(WorldContext);
@@ -93,125 +94,205 @@ TArray<FBranch> UPlant::GetBranchTransforms() const
 	return Root->GetBranchTransforms();
 }
 
-void UPlant::CalculateVigor()
+UBranchModule* UPlant::GetRoot() const
+{
+	return Root;
+}
+
+void UPlant::SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap,
+                                 UBranchModuleManager* InModuleManager, const FSpeciesTable& InSpecies)
+{
+	if (Ar.IsLoading())
+	{
+		BranchModuleManager = InModuleManager;
+		Species = &InSpecies;
+		bInitialized = true;
+		bSortedModulesDirty = true;
+	}
+
+	Ar << Position;
+	Ar << SpeciesID;
+	Ar << VRootMax;
+	Ar << State;
+	Ar << PT;
+	Ar << NumberOfModules;
+
+	int32 Seed = RandomStream.GetCurrentSeed();
+	Ar << Seed;
+
+	if (Ar.IsLoading())
+	{
+		RandomStream.Initialize(Seed);
+
+		if (!Species->IsValidSpecies(SpeciesID))
+		{
+			Ar.SetError();
+			return;
+		}
+	}
+
+	ModuleMap.Serialize(Ar, Root);
+
+	// Only dead plants have no root, and a root attached to another module would be part of a loop
+	if (Ar.IsLoading() && (Root == nullptr ? State != EPlantState::Dead : Root->GetParent() != nullptr))
+	{
+		Ar.SetError();
+	}
+}
+
+void UPlant::CalculateVigor(const float TimeStep)
 {
-	// Sort the nodes into a topological order for a basipetal pass
-	TArray<UBranchModule*> SortedModules = TopologicalSortModules();
+	// The modules are kept in a topological order for a basipetal pass, with the links to their children flattened
+	// into indices into that order
+	const TArray<UBranchModule*>& Modules = TopologicalSortModules();
+	const int32 NumModules = Modules.Num();
 
-	// Accumulate Qu into Qtotal at uroot
-	for (UBranchModule* Module : SortedModules)
+	// Accumulate Qu into Qtotal at uroot, children come before their parents so their totals are already known
+	for (int32 i = 0; i < NumModules; i++)
 	{
 		float LightExposure = 0.f;
 
 		// Sum up all Qus
-		for (UBranchModule* Child : Module->GetChildren())
+		for (int32 Child = FirstChildModules[i]; Child != INDEX_NONE; Child = NextSiblingModules[Child])
 		{
-			LightExposure += Child->GetLightExposure();
+			LightExposure += ModuleLightExposures[Child];
 		}
 
-		Module->IncreaseLightExposure(LightExposure);
+		Modules[i]->IncreaseLightExposure(LightExposure);
+		ModuleLightExposures[i] = Modules[i]->GetLightExposure();
 	}
 
 	const float QTotal = Root->GetLightExposure();
 	UE_LOG(LogForestGenerator, Log, TEXT("Plant: Qtotal = %f."), QTotal);
 
 	// To simulate gradual plant senescence, reduce the vigor once plant reaches max age
-	const float PMax = static_cast<float>(Settings.PMax);
+	const float PMax = static_cast<float>(Species->PMax[SpeciesID]);
 	if (PT >= PMax)
 	{
 		// Linearly interpolate Vrootmax to zero
 		const float LerpAlpha = (PT - PMax) / PMax;
 		// Note could use Lerp here instead of stable if this is slowing system down
-		Settings.VRootMax = FMath::LerpStable(0.f, Settings.VRootMax, LerpAlpha);
+		VRootMax = FMath::LerpStable(0.f, VRootMax, LerpAlpha);
 	}
 
+	// Go through the list backwards as redistributing in an acropetal pass
+	ensure(Modules.Last() == Root);
+
 	// Vu is always clamped to Vrootmax as plants can only store so much energy
-	float VU = FMath::Min(QTotal, Settings.VRootMax);
+	ModuleVigors[NumModules - 1] = FMath::Min(QTotal, VRootMax);
 
-	// Reverse the list as redistributing in an acropetal pass
-	Algo::Reverse(SortedModules);
-	ensure(SortedModules[0] == Root);
-	Root->SetVigor(VU);
+	const float ApicalControl = Species->ApicalControl[SpeciesID];
 
 	// Redistribute Vu through plant
-	for (UBranchModule* Module : SortedModules)
+	for (int32 i = NumModules - 1; i >= 0; i--)
 	{
-		VU = Module->GetVigor();
+		const float VU = ModuleVigors[i];
+
+		// Children are kept in the order they were attached, so the first has the lowest ID and is the main child
+		const int32 MainChild = FirstChildModules[i];
 
-		TArray<UBranchModule*> Children = Module->GetChildren();
+		if (MainChild == INDEX_NONE)
+		{
+			continue;
+		}
 
-		if (Children.Num() == 1)
+		if (NextSiblingModules[MainChild] == INDEX_NONE)
 		{
 			// If the module only has one child, the remaining vigor goes to them
-			UBranchModule* Child = Children[0];
-			Child->SetVigor(VU);
+			ModuleVigors[MainChild] = VU;
 		}
-		else if (Children.Num() > 1)
+		else
 		{
-			UBranchModule* MainChild = nullptr;
-
-			for (UBranchModule* Child : Children)
-			{
-				if (MainChild != nullptr)
-				{
-					MainChild = (Child->GetID() < MainChild->GetID()) ? Child : MainChild;
-				}
-				else
-				{
-					MainChild = Child;
-				}
-			}
-
-			Children.Remove(MainChild);
-
-			const float QUM = MainChild->GetLightExposure();
-			const float QUL = Module->GetLightExposure() - QUM;
-			const float Lambda = Settings.ApicalControl;
+			const float QUM = ModuleLightExposures[MainChild];
+			const float QUL = ModuleLightExposures[i] - QUM;
 
 			// Eq 2
-			float VUM = 0.f;
-			
-			if (QUM != 0.f)
-			{
-				VUM = VU * (Lambda * QUM) / (Lambda * QUM + (1 - Lambda) * QUL);
-			}
-			
+			const float VUM = FGrowthModel::GetMainChildVigor(VU, QUM, QUL, ApicalControl);
 			const float VUL = VU - VUM;
 
-			MainChild->SetVigor(VUM);
+			ModuleVigors[MainChild] = VUM;
 
-			for (UBranchModule* Child : Children)
+			for (int32 Child = NextSiblingModules[MainChild]; Child != INDEX_NONE; Child = NextSiblingModules[Child])
 			{
-				Child->SetVigor(VUL);
+				ModuleVigors[Child] = VUL;
 			}
 		}
 	}
 
-	ShedModules(SortedModules);
+	// Equations 5 and 6 only need each module's vigor, so they are done for every module at once rather than one
+	// at a time as the modules grow
+	FGrowthModel::CalculateDeltaAges(ModuleVigors, ModuleDeltaAges, Species->VMin[SpeciesID],
+	                                 Species->VMax[SpeciesID], Species->Gp[SpeciesID], TimeStep);
+
+	for (int32 i = 0; i < NumModules; i++)
+	{
+		Modules[i]->SetVigor(ModuleVigors[i]);
+		Modules[i]->SetDeltaAge(ModuleDeltaAges[i]);
+	}
+
+	ShedModules(Modules);
 }
 
-void UPlant::Grow(const float TimeStep) const
+void UPlant::Grow(const int32 ModuleBudget)
 {
 	if (Root != nullptr)
 	{
-		const bool bCanSpawnChildren = BranchModuleManager->GetNumberOfModules() < 100;
-		Root->Grow(TimeStep, Settings.VMin, Settings.VMax, Settings.Gp, Settings.Phi, Settings.Beta, Settings.LMax,
-		           Settings.G1, Settings.Alpha, FVector::DownVector, Settings.TropismStrength, Settings.Straightness,
-		           Settings.ApicalControl, Settings.Determinacy, bCanSpawnChildren);
+		int32 RemainingModuleBudget = ModuleBudget;
+
+		// Modules were moved by their parents last step, so bring every node position up to date in one pass first
+		Root->ResolveNodePositions();
+
+		bSortedModulesDirty |= Root->Grow(*Species, SpeciesID, FVector::DownVector, RemainingModuleBudget);
+
+		NumberOfModules += ModuleBudget - RemainingModuleBudget;
 	}
 }
 
 
-TArray<UBranchModule*> UPlant::TopologicalSortModules() const
+const TArray<UBranchModule*>& UPlant::TopologicalSortModules()
 {
-	TArray<UBranchModule*> SortedNodes;
+	if (!bSortedModulesDirty)
+	{
+		return SortedModules;
+	}
 
-	Root->Visit(SortedNodes);
+	SortedModules.Reset();
 
-	for (UBranchModule* SortedNode : SortedNodes)
+	Root->Visit(SortedModules);
+
+	const int32 NumModules = SortedModules.Num();
+	FirstChildModules.Init(INDEX_NONE, NumModules);
+	NextSiblingModules.Init(INDEX_NONE, NumModules);
+	ModuleLightExposures.SetNumUninitialized(NumModules);
+	ModuleVigors.SetNumUninitialized(NumModules);
+
+	// Each module comes straight after the subtrees of its children, so the last subtrees still waiting for a parent
+	// are its children, in the order they were visited
+	TArray<int32> Subtrees;
+
+	for (int32 i = 0; i < NumModules; i++)
 	{
-		SortedNode->ResetSortMark();
+		UBranchModule* SortedModule = SortedModules[i];
+		SortedModule->ResetSortMark();
+
+		const int32 NumChildren = SortedModule->GetChildren().Num();
+		const int32 FirstChild = Subtrees.Num() - NumChildren;
+
+		if (NumChildren > 0)
+		{
+			FirstChildModules[i] = Subtrees[FirstChild];
+		}
+
+		for (int32 j = FirstChild; j < Subtrees.Num() - 1; j++)
+		{
+			NextSiblingModules[Subtrees[j]] = Subtrees[j + 1];
+		}
+
+		Subtrees.SetNum(FirstChild, false);
+		Subtrees.Add(i);
 	}
 
-	return SortedNodes;
+	bSortedModulesDirty = false;
+
+	return SortedModules;
 }
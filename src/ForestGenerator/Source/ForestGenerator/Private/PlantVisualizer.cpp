@@ -48,20 +48,17 @@ void APlantVisualizer::BeginPlay()
 		return;
 	}
 
-	const TArray<FName> PlantNames = PlantTypes->GetRowNames();
-	if (PlantNames.Num() == 0)
+	if (Species.Compile(PlantTypes) == 0)
 	{
 		UE_LOG(LogForestGenerator, Error, TEXT("PlantVis: No Plant Types found in data table."));
 		return;
 	}
 
-	const FName PlantName = PlantNames[0];
-	UE_LOG(LogForestGenerator, Log, TEXT("Using plant: %s"), *PlantName.ToString());
-
-	const FPlantSettings PlantSettings = *PlantTypes->FindRow<FPlantSettings>(PlantName, "");
+	const int32 SpeciesID = 0;
+	UE_LOG(LogForestGenerator, Log, TEXT("Using plant: %s"), *Species.Names[SpeciesID].ToString());
 
 	Plant = NewObject<UPlant>();
-	if (!Plant->Initialize(ModuleManager, GetActorLocation(), PlantSettings))
+	if (!Plant->Initialize(ModuleManager, GetActorLocation(), Species, SpeciesID))
 	{
 		UE_LOG(LogForestGenerator, Error, TEXT("PlantVis: Couldn't initialize Plant."));
 		return;
@@ -87,7 +84,8 @@ void APlantVisualizer::Simulate()
 	}
 
 	ModuleManager->CalculateLightExposures();
-	Plant->Simulate();
+	// A single plant has the whole module budget to itself
+	Plant->Simulate(1.f, MAX_int32);
 
 	Render();
 
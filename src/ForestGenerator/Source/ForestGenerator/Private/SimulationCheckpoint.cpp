@@ -0,0 +1,74 @@
+// Ollie Nicholls, 2021
+
+
+#include "SimulationCheckpoint.h"
+
+#include "BranchModule.h"
+
+void FCheckpointModuleMap::AddWithChildren(UBranchModule* Module)
+{
+	if (Module == nullptr || Indices.Contains(Module))
+	{
+		return;
+	}
+
+	// Breadth first so modules are only visited once however deep the plant is
+	int32 Next = Modules.Num();
+	Indices.Add(Module, Modules.Add(Module));
+
+	for (; Next < Modules.Num(); Next++)
+	{
+		for (UBranchModule* Child : Modules[Next]->GetChildren())
+		{
+			if (!Indices.Contains(Child))
+			{
+				Indices.Add(Child, Modules.Add(Child));
+			}
+		}
+	}
+}
+
+int32 FCheckpointModuleMap::GetIndex(const UBranchModule* Module) const
+{
+	const int32* Index = Indices.Find(Module);
+	return Index != nullptr ? *Index : INDEX_NONE;
+}
+
+UBranchModule* FCheckpointModuleMap::GetModule(const int32 Index) const
+{
+	return Modules.IsValidIndex(Index) ? Modules[Index] : nullptr;
+}
+
+void FCheckpointModuleMap::Serialize(FArchive& Ar, UBranchModule*& Module) const
+{
+	int32 Index = Ar.IsLoading() ? INDEX_NONE : GetIndex(Module);
+	Ar << Index;
+
+	if (Ar.IsLoading())
+	{
+		Module = GetModule(Index);
+	}
+}
+
+void FCheckpointModuleMap::Serialize(FArchive& Ar, TArray<UBranchModule*>& InModules) const
+{
+	int32 Num = InModules.Num();
+	Ar << Num;
+
+	if (Ar.IsLoading())
+	{
+		// A corrupt count shouldn't be able to allocate more references than there are modules
+		if (Num < 0 || Num > Modules.Num())
+		{
+			Ar.SetError();
+			return;
+		}
+
+		InModules.SetNumZeroed(Num);
+	}
+
+	for (UBranchModule*& Module : InModules)
+	{
+		Serialize(Ar, Module);
+	}
+}
@@ -0,0 +1,128 @@
+// Ollie Nicholls, 2021
+
+
+#include "SpeciesTable.h"
+
+#include "Engine/DataTable.h"
+#include "ForestGeneratorLog.h"
+
+int32 FSpeciesTable::Compile(const UDataTable* PlantTypes)
+{
+	Reset();
+
+	if (PlantTypes == nullptr)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Species Table: No plant types to compile."));
+		return 0;
+	}
+
+	for (const FName& PlantName : PlantTypes->GetRowNames())
+	{
+		const FPlantSettings* Settings = PlantTypes->FindRow<FPlantSettings>(PlantName, "", false);
+
+		if (Settings != nullptr)
+		{
+			AddSpecies(PlantName, *Settings);
+		}
+	}
+
+	return Num();
+}
+
+int32 FSpeciesTable::AddSpecies(const FName Name, const FPlantSettings& Settings)
+{
+	Names.Add(Name);
+
+	PMax.Add(FMath::Max(Settings.PMax, 0));
+	VRootMax.Add(FMath::Max(Settings.VRootMax, 0.f));
+	Gp.Add(FMath::Max(Settings.Gp, 0.f));
+	ApicalControl.Add(FMath::Clamp(Settings.ApicalControl, 0.f, 1.f));
+	ApicalControlMature.Add(FMath::Clamp(Settings.ApicalControlMature, 0.f, 1.f));
+	Determinacy.Add(FMath::Clamp(Settings.Determinacy, 0.f, 1.f));
+	DeterminacyMature.Add(FMath::Clamp(Settings.DeterminacyMature, 0.f, 1.f));
+	FAge.Add(FMath::Max(Settings.FAge, 0));
+	Alpha.Add(FMath::Clamp(Settings.Alpha, -1.f, 1.f));
+	W2.Add(FMath::Clamp(Settings.W2, 0.f, 1.f));
+	G1.Add(FMath::Clamp(Settings.G1, -5.f, 5.f));
+	Phi.Add(FMath::Max(Settings.Phi, 0.f));
+	Beta.Add(FMath::Max(Settings.Beta, 0.f));
+	LMax.Add(FMath::Max(Settings.LMax, 0.f));
+	TropismStrength.Add(FMath::Max(Settings.TropismStrength, 0.f));
+	Straightness.Add(FMath::Clamp(Settings.Straightness, 0.f, 1.f));
+
+	const float SpeciesVMin = FMath::Max(Settings.VMin, 0.f);
+	const float SpeciesVMax = FMath::Max(Settings.VMax, 0.f);
+
+	VMin.Add(SpeciesVMin);
+	VMax.Add(SpeciesVMax <= SpeciesVMin ? SpeciesVMin + .1f : SpeciesVMax);
+
+	return Names.Num() - 1;
+}
+
+int32 FSpeciesTable::FindSpecies(const FName Name) const
+{
+	return Names.IndexOfByKey(Name);
+}
+
+bool FSpeciesTable::IsValidSpecies(const int32 SpeciesID) const
+{
+	return Names.IsValidIndex(SpeciesID);
+}
+
+int32 FSpeciesTable::Num() const
+{
+	return Names.Num();
+}
+
+void FSpeciesTable::Reset()
+{
+	Names.Reset();
+	PMax.Reset();
+	VRootMax.Reset();
+	Gp.Reset();
+	ApicalControl.Reset();
+	ApicalControlMature.Reset();
+	Determinacy.Reset();
+	DeterminacyMature.Reset();
+	FAge.Reset();
+	Alpha.Reset();
+	W2.Reset();
+	G1.Reset();
+	Phi.Reset();
+	Beta.Reset();
+	VMin.Reset();
+	VMax.Reset();
+	LMax.Reset();
+	TropismStrength.Reset();
+	Straightness.Reset();
+}
+
+FArchive& operator<<(FArchive& Ar, FSpeciesTable& Species)
+{
+	Ar << Species.Names;
+	Ar << Species.PMax << Species.VRootMax << Species.Gp << Species.ApicalControl << Species.ApicalControlMature;
+	Ar << Species.Determinacy << Species.DeterminacyMature << Species.FAge << Species.Alpha << Species.W2;
+	Ar << Species.G1 << Species.Phi << Species.Beta << Species.VMin << Species.VMax << Species.LMax;
+	Ar << Species.TropismStrength << Species.Straightness;
+
+	if (Ar.IsLoading())
+	{
+		const int32 NumSpecies = Species.Num();
+
+		// Plants index every array with their species ID, so they all have to be the same length
+		if (Species.PMax.Num() != NumSpecies || Species.VRootMax.Num() != NumSpecies ||
+			Species.Gp.Num() != NumSpecies || Species.ApicalControl.Num() != NumSpecies ||
+			Species.ApicalControlMature.Num() != NumSpecies || Species.Determinacy.Num() != NumSpecies ||
+			Species.DeterminacyMature.Num() != NumSpecies || Species.FAge.Num() != NumSpecies ||
+			Species.Alpha.Num() != NumSpecies || Species.W2.Num() != NumSpecies || Species.G1.Num() != NumSpecies ||
+			Species.Phi.Num() != NumSpecies || Species.Beta.Num() != NumSpecies || Species.VMin.Num() != NumSpecies ||
+			Species.VMax.Num() != NumSpecies || Species.LMax.Num() != NumSpecies ||
+			Species.TropismStrength.Num() != NumSpecies || Species.Straightness.Num() != NumSpecies)
+		{
+			Ar.SetError();
+			Species.Reset();
+		}
+	}
+
+	return Ar;
+}
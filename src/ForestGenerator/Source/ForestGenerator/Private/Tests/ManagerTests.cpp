@@ -0,0 +1,141 @@
+// Ollie Nicholls, 2021
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/DataTable.h"
+#include "Manager.h"
+#include "Serialization/MemoryWriter.h"
+#include "SimulationCheckpoint.h"
+
+namespace
+{
+	/**
+	 * @brief Get a manager's checkpoint without the header and settings at the start of it, so simulations that only
+	 * differ in how the plants were simulated can be compared.
+	 */
+	TArray<uint8> GetCheckpointAfterSettings(UManager* Manager, FSimulationSettings Settings)
+	{
+		TArray<uint8> Checkpoint;
+
+		if (!Manager->SaveCheckpointToMemory(Checkpoint))
+		{
+			return Checkpoint;
+		}
+
+		TArray<uint8> Header;
+		FMemoryWriter Ar{Header};
+
+		uint32 Magic = FCheckpointModuleMap::Magic;
+		int32 Version = FCheckpointModuleMap::Version;
+		Ar << Magic << Version << Settings;
+
+		Checkpoint.RemoveAt(0, FMath::Min(Header.Num(), Checkpoint.Num()));
+		return Checkpoint;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FManagerResumeMidStepTest, "ForestGenerator.Manager.ResumeMidStep",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FManagerResumeMidStepTest::RunTest(const FString& Parameters)
+{
+	UDataTable* PlantTypes = LoadObject<UDataTable>(nullptr, TEXT("/ForestGenerator/DT_PlantTypes.DT_PlantTypes"));
+	UClass* Prototype = LoadClass<UBranchModule>(nullptr, TEXT("/ForestGenerator/BP_BMP_Testing.BP_BMP_Testing_C"));
+
+	if (!TestNotNull(TEXT("Plant types"), PlantTypes) || !TestNotNull(TEXT("Branch module prototype"), Prototype))
+	{
+		return false;
+	}
+
+	const TArray<TSubclassOf<UBranchModule>> BranchModulePrototypes{Prototype};
+
+	FSimulationSettings Settings;
+	Settings.NumberOfPlants = 3;
+	Settings.Time = 40;
+
+	// The whole simulation without stopping
+	UManager* Uninterrupted = NewObject<UManager>();
+	Uninterrupted->Simulate(Settings, BranchModulePrototypes, PlantTypes);
+
+	// Time sliced with no budget simulates one plant per slice, so this stops after the first plant of a step
+	UManager* Interrupted = NewObject<UManager>();
+	Interrupted->Initialize(Settings, BranchModulePrototypes, PlantTypes);
+
+	for (int32 Slice = 0; Slice < Settings.NumberOfPlants * Settings.Time / 2 + 1; Slice++)
+	{
+		Interrupted->SimulateSlice(0.f);
+	}
+
+	TArray<uint8> MidStep;
+	TestTrue(TEXT("Saved mid step"), Interrupted->SaveCheckpointToMemory(MidStep));
+
+	UManager* Resumed = NewObject<UManager>();
+	TestTrue(TEXT("Loaded mid step"), Resumed->LoadCheckpointFromMemory(MidStep, BranchModulePrototypes));
+	Resumed->ResumeSimulation(Settings.Time, ESimulationMode::Blocking);
+
+	TArray<uint8> Expected;
+	TArray<uint8> Actual;
+	TestTrue(TEXT("Saved uninterrupted"), Uninterrupted->SaveCheckpointToMemory(Expected));
+	TestTrue(TEXT("Saved resumed"), Resumed->SaveCheckpointToMemory(Actual));
+
+	TestEqual(TEXT("Resumed steps"), Resumed->GetSimulationProgress().Step,
+	          Uninterrupted->GetSimulationProgress().Step);
+	TestTrue(TEXT("Resumed simulation matches the uninterrupted one"), Actual == Expected);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FManagerDeterminismTest, "ForestGenerator.Manager.Determinism",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FManagerDeterminismTest::RunTest(const FString& Parameters)
+{
+	UDataTable* PlantTypes = LoadObject<UDataTable>(nullptr, TEXT("/ForestGenerator/DT_PlantTypes.DT_PlantTypes"));
+	UClass* Prototype = LoadClass<UBranchModule>(nullptr, TEXT("/ForestGenerator/BP_BMP_Testing.BP_BMP_Testing_C"));
+
+	if (!TestNotNull(TEXT("Plant types"), PlantTypes) || !TestNotNull(TEXT("Branch module prototype"), Prototype))
+	{
+		return false;
+	}
+
+	const TArray<TSubclassOf<UBranchModule>> BranchModulePrototypes{Prototype};
+
+	FSimulationSettings Settings;
+	Settings.NumberOfPlants = 5;
+	Settings.Time = 40;
+	Settings.Seed = 7;
+
+	Settings.bParallelPlants = false;
+	UManager* Serial = NewObject<UManager>();
+	Serial->Simulate(Settings, BranchModulePrototypes, PlantTypes);
+
+	Settings.bParallelPlants = true;
+	UManager* Parallel = NewObject<UManager>();
+	Parallel->Simulate(Settings, BranchModulePrototypes, PlantTypes);
+
+	// Time sliced with no budget simulates one plant per slice, so there is at most a slice per plant per step
+	UManager* TimeSliced = NewObject<UManager>();
+	TimeSliced->Initialize(Settings, BranchModulePrototypes, PlantTypes);
+
+	bool bTimeSlicedFinished = false;
+
+	for (int32 Slice = 0; Slice < (Settings.MaxNumberOfPlants + 1) * Settings.Time && !bTimeSlicedFinished; Slice++)
+	{
+		bTimeSlicedFinished = TimeSliced->SimulateSlice(0.f);
+	}
+
+	const TArray<uint8> Expected = GetCheckpointAfterSettings(Serial, Settings);
+
+	TestTrue(TEXT("Saved serial"), Expected.Num() > 0);
+	TestTrue(TEXT("Time sliced simulation finished"), bTimeSlicedFinished);
+	TestTrue(TEXT("Parallel simulation matches the serial one"),
+	         GetCheckpointAfterSettings(Parallel, Settings) == Expected);
+	TestTrue(TEXT("Time sliced simulation matches the serial one"),
+	         GetCheckpointAfterSettings(TimeSliced, Settings) == Expected);
+
+	return true;
+}
+
+#endif
@@ -5,13 +5,16 @@
 #include "CoreMinimal.h"
 
 #include "Branch.h"
+#include "BranchGraph.h"
+#include "SphereBatch.h"
 #include "UObject/NoExportTypes.h"
 
 #include "BranchModule.generated.h"
 
-class UBranchNode;
-class UBranchSegment;
 class UBranchModuleManager;
+struct FBranchModuleTemplate;
+struct FCheckpointModuleMap;
+struct FSpeciesTable;
 
 /**
 * @brief 
@@ -53,32 +56,22 @@ struct FGraphDefinition
 		: Edges(Edges)
 	{
 	}
-};
-
-/**
-* @brief
-*/
-USTRUCT(BlueprintType)
-struct FBranchGraph
-{
-	GENERATED_BODY()
-
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	UBranchNode* Root;
-
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	TArray<UBranchNode*> Nodes;
-
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	TArray<UBranchSegment*> Branches;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	TArray<UBranchSegment*> AvailableBranches;
+	/**
+	 * @brief Get the source and destination ID of each edge, as used to compile a template.
+	 */
+	TArray<TPair<int32, int32>> GetEdges() const
+	{
+		TArray<TPair<int32, int32>> EdgePairs;
+		EdgePairs.Reserve(Edges.Num());
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	int32 PhysiologicalAge = 0;
+		for (const FGraphEdge& Edge : Edges)
+		{
+			EdgePairs.Emplace(Edge.Source, Edge.Destination);
+		}
 
-	FBranchGraph() = default;
+		return EdgePairs;
+	}
 };
 
 /**
@@ -107,7 +100,25 @@ public:
 
 	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
 	void Initialize(const FGraphDefinition& NewGraphDefinition, const FVector& InPosition,
-	                UBranchModuleManager* InModuleManager, const FRotator InOrientation);
+	                UBranchModuleManager* InModuleManager, const FRotator InOrientation, const int32 InSeed = 0);
+
+	/**
+	 * @brief Initializes the module with a copy of the graph of a compiled template.
+	 * @param Template The template compiled from the module's graph definition
+	 * @param InPosition The position of the root node
+	 * @param InModuleManager The module manager tracking this module
+	 * @param InOrientation The rotation applied to the direction of the root node
+	 * @param InSeed The seed of the module's random stream
+	 */
+	void InitializeFromTemplate(const FBranchModuleTemplate& Template, const FVector& InPosition,
+	                            UBranchModuleManager* InModuleManager, const FRotator InOrientation,
+	                            const int32 InSeed = 0);
+
+	/**
+	 * @brief Clears everything left over from the module's last use, so it can be initialized again when taken from
+	 * the module manager's pool.
+	 */
+	void Reset();
 
 	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
 	void SetID(const int32 InID);
@@ -115,6 +126,11 @@ public:
 	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
 	void SetVigor(const float InVigor);
 
+	/**
+	 * @brief Set how much the module ages in its next call to Grow, from equations 5 and 6.
+	 */
+	void SetDeltaAge(const float InDeltaAge);
+
 	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
 	void ResetSortMark();
 
@@ -133,6 +149,11 @@ public:
 	UFUNCTION(BlueprintGetter, Category = "Forest Generator")
 	const TArray<UBranchModule*>& GetChildren() const;
 
+	/**
+	 * @brief Get the module this one is attached to, nullptr for the root module of a plant.
+	 */
+	UBranchModule* GetParent() const;
+
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	void DrawBoundingSphere(const UWorld* WorldContext) const;
 
@@ -143,16 +164,17 @@ public:
 	void Visit(TArray<UBranchModule*>& SortedNodes);
 
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
-	UBranchNode* GetRootNode();
-	
-	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
-	UBranchModule* AttachNewBranchModule(UBranchNode* ParentNode, const float ApicalControl, const float Determinacy);
+	UBranchModule* AttachNewBranchModule(const int32 ParentNode, const float ApicalControl, const float Determinacy);
 
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	void CalculatePerNodeVigor(const float ApicalControl);
 
+	/**
+	 * @brief Detaches this module from its parent and marks it and every module attached to it as shed.
+	 * @return How many modules were shed
+	 */
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
-	void Shed();
+	int32 Shed();
 
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	bool IsShed();
@@ -161,50 +183,105 @@ public:
 	* @brief Section 5.3 of the paper.
 	* The main module development function that handles aging, adding new nodes,
 	* adapting node positions due to tropism, attaching new modules, and branch segment growing.
-	* @param DT Delta time since last call, the simulation time step in the main loop
-	* @param VMin Minimum vigor clamp
-	* @param VMax Maximum vigor clamp
-	* @param GP Growth potential
-	* @param Phi The default thickness of branches
-	* @param Beta Branch length scaling coefficient
-	* @param LMax Max branch length
-	* @param G1 Control how fast the effect of tropism decreases with time
-	* @param Alpha Control the angle of tropism, negative represents gravitropsim, positive phototropism
+	* Each module ages by the delta age set by the plant, which works out the growth rates of all its modules at once.
+	* @param Species The settings of every species
+	* @param SpeciesID The species of the plant the module belongs to, its settings are read from Species
 	* @param GDir Normalized direction of gravity
-	* @param TropismStrength The overall strength of the tropism
-	* @param Straightness How straight the growth of the plant is
-	* @param ApicalControl The ratio of limiting lateral buds leading to a plant developing a trunk
-	* @param Determinacy Where buds develop into flowers preventing further growth
-	* @param bCanSpawnChildren If the branch can spawn children or not
+	* @param ModuleBudget How many more modules can be attached, reduced by one for each module attached
+	* @return If any modules were attached to or removed from this module or any of its children
 	*/
-	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
-	void Grow(const float DT, const float VMin, const float VMax, const float GP, const float Phi,
-	          const float Beta, const float LMax, const float G1, const float Alpha,
-	          const FVector& GDir, const float TropismStrength, const float Straightness, const float ApicalControl,
-	          const float Determinacy, const bool bCanSpawnChildren);
+	bool Grow(const FSpeciesTable& Species, const int32 SpeciesID, const FVector& GDir, int32& ModuleBudget);
 
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
-	TArray<UBranchNode*> TopologicalSortNodes() const;
+	const TArray<int32>& TopologicalSortNodes();
 
 	TArray<FBranch> GetBranchTransforms() const;
 
+	/**
+	 * @brief Update the world positions of the nodes in this module and all its child modules from their offsets.
+	 */
+	void ResolveNodePositions();
+
 	void Orientate(const TArray<FSphere> Neighbors, const FRotator& InitialOrientation);
-	void CalculateLightExposure(const TArray<FSphere>& IntersectingNeighbors);
+	void CalculateLightExposure(const FSphereBatch& IntersectingNeighbors);
+	void CalculateLightExposure(const float Shadow);
 	const FSphere& GetBoundingSphere() const;
 	float GetAge();
 	static float CalculateCollisions(const FSphere& Sphere, const TArray<FSphere>& IntersectingNeighbors);
+	static float CalculateCollisions(const FSphere& Sphere, const FSphereBatch& IntersectingNeighbors);
 	static float CalculateIntersectingVolume(const FSphere& Sphere, const FSphere& Neighbor);
 
+	/**
+	 * @brief Set the ID of the proxy representing this module in the module manager's bounds tree.
+	 */
+	void SetBoundsProxy(const int32 InBoundsProxy);
+
+	/**
+	 * @brief Get the ID of the proxy representing this module in the module manager's bounds tree.
+	 */
+	int32 GetBoundsProxy() const;
+
+	/**
+	 * @brief Set the index of this module in the module manager's list of modules.
+	 */
+	void SetManagerIndex(const int32 InManagerIndex);
+
+	/**
+	 * @brief Get the index of this module in the module manager's list of modules.
+	 */
+	int32 GetManagerIndex() const;
+
+	/**
+	 * @brief Set the index of the template this module was generated from in the module manager.
+	 */
+	void SetTemplateIndex(const int32 InTemplateIndex);
+
+	/**
+	 * @brief Get the index of the template this module was generated from in the module manager.
+	 */
+	int32 GetTemplateIndex() const;
+
+	/**
+	 * @brief If the bounding sphere has changed since the light exposure was last calculated.
+	 */
+	bool IsLightExposureDirty() const;
+
+	/**
+	 * @brief Forces the light exposure to be recalculated in the next light exposure pass.
+	 */
+	void MarkLightExposureDirty();
+
+	/**
+	 * @brief Resets the light exposure to the value last calculated, as it gets accumulated into by the plant's vigor
+	 * pass every step.
+	 */
+	void RestoreLightExposure();
+
+	/**
+	 * @brief Saves or loads the state of the module for a checkpoint.
+	 * Once every module has been loaded, ReconnectChildGraphs has to be called on each of them.
+	 * @param Ar The archive
+	 * @param ModuleMap The modules in the checkpoint
+	 * @param InModuleManager The module manager tracking this module, only used when loading
+	 */
+	void SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap, UBranchModuleManager* InModuleManager);
+
+	/**
+	 * @brief Connects the graphs of the child modules to this module's graph after loading a checkpoint.
+	 * @return If every child was attached to its own connecting node, every connecting node got a child and no child
+	 * was already attached to another module
+	 */
+	bool ReconnectChildGraphs();
+
 protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Forest Generator")
 	FGraphDefinition GraphDefinition;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
+	/**
+	 * @brief The nodes and branch segments of this module. Not a UPROPERTY as it holds no UObjects.
+	 */
 	FBranchGraph Graph;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
-	TArray<UBranchNode*> FinalNodes;
-
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	float PhysiologicalAge = 0;
 
@@ -214,9 +291,19 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	UBranchModuleManager* ModuleManager;
 
+	/**
+	 * @brief The modules attached to this one in the order they were attached. IDs are handed out in the same order,
+	 * so the first child is always the main child.
+	 */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	TArray<UBranchModule*> Children;
 
+	/**
+	 * @brief The module this one is attached to, nullptr for the root module of a plant and once shed.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
+	UBranchModule* Parent = nullptr;
+
 	/**
 	* @brief The ID
 	* This is helpful when determining if this branch is main or lateral as main branch will always have a lower ID
@@ -226,12 +313,42 @@ protected:
 
 	FSphere BoundingSphere;
 
+	/**
+	 * @brief The proxy in the module manager's bounds tree, INDEX_NONE when not tracked.
+	 */
+	int32 BoundsProxy = INDEX_NONE;
+
+	/**
+	 * @brief The index in the module manager's list of modules, INDEX_NONE when not tracked.
+	 */
+	int32 ManagerIndex = INDEX_NONE;
+
+	/**
+	 * @brief The template in the module manager this module was generated from, used to pool it once removed.
+	 */
+	int32 TemplateIndex = 0;
+
+	/**
+	 * @brief Set whenever the bounding sphere changes and cleared when the light exposure is calculated.
+	 */
+	bool bLightExposureDirty = true;
+
+	/**
+	 * @brief The light exposure from the last time it was calculated.
+	 */
+	float CalculatedLightExposure = 0.f;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	float LightExposure = 0.f;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	float Vigor = 0.f;
 
+	/**
+	 * @brief How much to age by in the next call to Grow, set by the plant after distributing vigor.
+	 */
+	float DeltaAge = 0.f;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	ESortMark SortMark = ESortMark::None;
 
@@ -241,13 +358,18 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
 	bool bShed = false;
 
+	/**
+	 * @brief The stream used to place new nodes and to seed child modules, so a module grows the same way no matter
+	 * what else is being simulated.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Forest Generator")
+	FRandomStream RandomStream;
+
 private:
 	void CalculateBoundingSphere();
-	void SpawnChildNodes(UBranchNode* Parent, const float Straightness) const;
-	void GrowGraph(const float Straightness);
-	void IncreaseAge(const float DeltaAge, const float Straightness);
-	TArray<UBranchNode*> GetAvailableNodes();
-	TArray<UBranchNode*> GetTerminalNodes();
+	void IncreaseAge(const float Straightness);
+	TArray<int32> GetAvailableNodes() const;
+	TArray<int32> GetTerminalNodes();
 
 	bool bTesting = true;
 };
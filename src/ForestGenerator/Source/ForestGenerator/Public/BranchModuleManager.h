@@ -3,12 +3,75 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+#include "BranchModuleTemplate.h"
+#include "DynamicBoundsTree.h"
+#include "ShadowGrid.h"
+#include "SphereBatch.h"
 #include "UObject/NoExportTypes.h"
+
 #include "BranchModuleManager.generated.h"
 
 class UBranchModule;
+struct FCheckpointModuleMap;
 struct FGraphDefinition;
 
+/**
+ * @brief How the light exposure of the branch modules is calculated.
+ */
+UENUM(BlueprintType)
+enum class ELightExposureModel : uint8
+{
+	/** Section 5.2.3: From the volume of the intersecting bounding spheres of neighboring modules */
+	SphereIntersection UMETA(DisplayName = "Sphere Intersection"),
+	/** From the shadow cast from above in a voxel grid, which also accounts for occlusion from modules above */
+	ShadowPropagation UMETA(DisplayName = "Shadow Propagation")
+};
+
+/**
+ * @brief Removed modules of one template, kept to be generated again instead of creating new objects.
+ */
+USTRUCT()
+struct FBranchModulePool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<UBranchModule*> Modules;
+};
+
+/**
+ * @brief Modules generated and removed while plants are simulated in parallel, to be applied to the module manager
+ * once all the plants are done.
+ */
+struct FDeferredModuleChanges
+{
+	/**
+	 * @brief The modules to remove along with the modules attached to them, these are removed before any are added as
+	 * plants shed modules before growing.
+	 */
+	TArray<UBranchModule*> RemovedModules;
+
+	/**
+	 * @brief The modules to add in the order they were generated.
+	 */
+	TArray<UBranchModule*> AddedModules;
+};
+
+/**
+ * @brief While in scope, modules generated or removed on this thread are recorded in the given changes instead of
+ * being applied to the module manager straight away.
+ */
+class FORESTGENERATOR_API FScopedDeferredModuleChanges
+{
+public:
+	explicit FScopedDeferredModuleChanges(FDeferredModuleChanges& Changes);
+	~FScopedDeferredModuleChanges();
+
+private:
+	FDeferredModuleChanges* PreviousChanges;
+};
+
 /**
  * This is used to keep track of all the branch modules in the simulation and is responsible for calling methods
  * that need to be called on all current branch modules.
@@ -33,11 +96,13 @@ public:
 	 * @param Determinacy D
 	 * @param InPosition The position where the branch module will be spawned
 	 * @param InitialOrientation The initial orientation used when optimizing the orientation
+	 * @param Seed The seed of the branch module's random stream
 	 * @return The newly created branch module
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	UBranchModule* GenerateBranchModule(int32 ApicalControl, int32 Determinacy, const FVector& InPosition,
-	                                    const FRotator& InitialOrientation = FRotator::ZeroRotator);
+	                                    const FRotator& InitialOrientation = FRotator::ZeroRotator,
+	                                    const int32 Seed = 0);
 
 	/**
 	 * @brief Signal all branch modules to calculate their light exposure.
@@ -46,15 +111,67 @@ public:
 	void CalculateLightExposures();
 
 	/**
-	 * @brief Removes a branch module from the simulation.
+	 * @brief Removes a branch module, and every module attached to it, from the simulation.
+	 * The last modules are swapped in to fill the gaps, so modules don't stay in the order they were generated.
+	 * The removed modules are pooled to be generated again from the same template.
 	 * @param BranchModule The branch module
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	void RemoveModule(UBranchModule* BranchModule);
+
+	/**
+	 * @brief Applies the changes recorded while simulating a plant in parallel. Must be called on the game thread.
+	 * Applying the changes of each plant in turn gives the same modules and IDs as simulating them one after another.
+	 * @param Changes The changes to apply, these are reset once applied
+	 */
+	void ApplyDeferredModuleChanges(FDeferredModuleChanges& Changes);
+
+	/**
+	 * @brief Set if the light exposures are calculated across worker threads or only on the calling thread.
+	 * Both give identical results.
+	 * @param bInParallelLightExposures If the light exposures should be calculated in parallel
+	 */
+	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
+	void SetParallelLightExposures(const bool bInParallelLightExposures);
+
+	/**
+	 * @brief Set how the light exposures are calculated.
+	 * @param InLightExposureModel The light exposure model
+	 */
+	UFUNCTION(BlueprintSetter, Category = "Forest Generator")
+	void SetLightExposureModel(const ELightExposureModel InLightExposureModel);
+
+	/**
+	 * @brief Set the parameters of the shadow propagation light exposure model.
+	 * @param InShadowVoxelSize The width of a voxel in the shadow grid
+	 * @param InShadowFalloff How much of the shadow is kept per voxel it moves down, between 0 and 1
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
+	void SetShadowParameters(const float InShadowVoxelSize, const float InShadowFalloff);
 	
 	UFUNCTION(BlueprintCallable, Category = "Forest Generator")
 	int GetNumberOfModules() const;
 
+	/**
+	 * @brief Allocates space for a number of modules so the module list and bounds tree don't need to grow while the
+	 * simulation is running.
+	 * @param NumModules How many modules to reserve space for
+	 */
+	void Reserve(const int32 NumModules);
+
+	/**
+	 * @brief Get all the branch modules in the simulation. Removing modules swaps others into their place, so these are
+	 * not in any particular order.
+	 */
+	const TArray<UBranchModule*>& GetBranchModules() const;
+
+	/**
+	 * @brief Saves or loads which modules are tracked and the state of the light exposure pass for a checkpoint.
+	 * @param Ar The archive
+	 * @param ModuleMap The modules in the checkpoint, already loaded when loading
+	 */
+	void SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap);
+
 protected:
 	/**
 	 * @brief The graph prototypes that can be chosen from.
@@ -62,12 +179,24 @@ protected:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
 	TArray<FGraphDefinition> GraphPrototypes;
 
+	/**
+	 * @brief The graph prototypes compiled into templates, in the same order as GraphPrototypes.
+	 */
+	TArray<FBranchModuleTemplate> ModuleTemplates;
+
 	/**
 	 * @brief All the branch modules in the simulation 
 	 */
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
 	TArray<UBranchModule*> BranchModules;
 
+	/**
+	 * @brief Modules removed from the simulation, in the same order as ModuleTemplates. These are not saved in
+	 * checkpoints, a module taken from a pool is reset and grows exactly as a new one would.
+	 */
+	UPROPERTY()
+	TArray<FBranchModulePool> ModulePools;
+
 	/**
 	 * @brief Which ID to give to the next spawned branch module
 	 */
@@ -80,6 +209,127 @@ protected:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
 	bool bInitialized = false;
 
+	/**
+	* @brief If the light exposures are calculated across worker threads.
+	*/
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
+	bool bParallelLightExposures = true;
+
+	/**
+	* @brief How the light exposures are calculated.
+	*/
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
+	ELightExposureModel LightExposureModel = ELightExposureModel::SphereIntersection;
+
+	/**
+	* @brief The width of a voxel in the shadow grid.
+	*/
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
+	float ShadowVoxelSize = 20.f;
+
+	/**
+	* @brief How much of the shadow is kept per voxel it moves down.
+	*/
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
+	float ShadowFalloff = 0.8f;
+
 private:
-	TArray<FSphere> GetNeighborBoundingSpheres(UBranchModule* QueryModule) const;
-};
+	/**
+	 * @brief Calculates the light exposures from the intersecting bounding spheres of neighboring modules.
+	 */
+	void CalculateSphereIntersectionLightExposures();
+
+	/**
+	 * @brief Calculates the light exposures from the shadow grid.
+	 */
+	void CalculateShadowPropagationLightExposures();
+
+	/**
+	 * @brief Gets the bounding spheres of all modules intersecting the given module.
+	 * Only reads the bounding sphere snapshot and the bounds tree so it is safe to call from multiple threads.
+	 * @param QueryIndex The index of the module in BranchModules
+	 * @param NeighborIndices Scratch array for the indices of the neighbors
+	 * @param OutNeighbors The intersecting bounding spheres in module ID order, this is reset before being filled
+	 */
+	void GetNeighborBoundingSpheres(const int32 QueryIndex, TArray<int32>& NeighborIndices,
+	                                FSphereBatch& OutNeighbors) const;
+
+	/**
+	 * @brief Gets the indices of all modules whose current bounding sphere intersects the given sphere.
+	 * Only finds modules whose proxy in the bounds tree is up to date.
+	 * @param Sphere The sphere to test against
+	 * @param OutIndices The indices of the modules, in no particular order, this is reset before being filled
+	 */
+	void GetIntersectingModules(const FSphere& Sphere, TArray<int32>& OutIndices) const;
+
+	/**
+	 * @brief Marks all modules intersecting the given sphere to have their light exposure recalculated this pass.
+	 * @param Sphere The sphere to test against
+	 * @param NeighborIndices Scratch array for the indices of the neighbors
+	 */
+	void MarkIntersectingModules(const FSphere& Sphere, TArray<int32>& NeighborIndices);
+
+	/**
+	 * @brief Moves the module's proxy in the bounds tree if its bounding sphere has left the fattened bounds.
+	 * @param BranchModule The module to update
+	 */
+	void UpdateBounds(UBranchModule* BranchModule);
+
+	/**
+	 * @brief Gives a generated module its ID and starts tracking it.
+	 * @param BranchModule The module to track
+	 */
+	void RegisterModule(UBranchModule* BranchModule);
+
+	/**
+	 * @brief Takes a module from the pool of a template, or creates a new one if the pool is empty.
+	 * Safe to call from the worker threads simulating plants in parallel.
+	 * @param TemplateIndex The template the module will be generated from
+	 * @return The module, ready to be initialized from the template
+	 */
+	UBranchModule* TakePooledModule(const int32 TemplateIndex);
+
+	/**
+	 * @brief Puts a removed module back in the pool of the template it was generated from.
+	 * @param BranchModule The module, no longer tracked by the manager
+	 */
+	void PoolModule(UBranchModule* BranchModule);
+
+	/**
+	 * @brief Broad phase used to find intersecting modules. Modules are inserted when generated, removed when
+	 * removed from the simulation and only reinserted once they grow out of their fattened bounds.
+	 */
+	TDynamicBoundsTree<UBranchModule*> BoundsTree;
+
+	/**
+	 * @brief The bounding spheres of all the modules, in the same order as BranchModules, taken at the start of the
+	 * light exposure pass, or when generated for modules added since. Only the spheres of modules that have changed are
+	 * updated each pass.
+	 */
+	TArray<FSphere> BoundingSpheres;
+
+	/**
+	 * @brief Which modules need their light exposure recalculated this pass, in the same order as BranchModules.
+	 */
+	TBitArray<> ModulesToRecalculate;
+
+	/**
+	 * @brief The indices of the modules that are having their light exposure recalculated this pass.
+	 */
+	TArray<int32> LightExposureQueue;
+
+	/**
+	 * @brief Set when every light exposure needs recalculating, such as when the light exposure model changes.
+	 */
+	bool bRecalculateAllLightExposures = true;
+
+	/**
+	 * @brief Used by the shadow propagation light exposure model, rebuilt every light exposure pass.
+	 */
+	FShadowGrid ShadowGrid;
+
+	/**
+	 * @brief Guards the module pools, as plants simulated in parallel generate modules from worker threads.
+	 */
+	FCriticalSection ModulePoolLock;
+};
\ No newline at end of file
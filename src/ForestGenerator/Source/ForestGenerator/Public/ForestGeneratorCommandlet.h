@@ -0,0 +1,38 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "ForestGeneratorCommandlet.generated.h"
+
+/**
+ * @brief Simulates forests without a world or rendering and writes them to disk, for generating forests in batches.
+ * Each forest is written as a checkpoint that can be loaded by the manager, and as a CSV of its branches.
+ *
+ * Usage: UE4Editor-Cmd <Project> -run=ForestGenerator -PlantTypes=<DataTable> -Prototypes=<Class>[,<Class>...]
+ *        -Output=<Directory> [-Seed=0] [-Count=1] [-Plants=1] [-MaxPlants=100] [-Time=1] [-TimeStep=1]
+ *        [-Temperature=20] [-Precipitation=1392] [-MaxModulesPerPlant=1000] [-MaxModules=100000] [-ShadowPropagation]
+ *        [-ParallelPlants] -nullrhi
+ * Plants are grown from the row of the plant types table named Testing, so the table needs one.
+ */
+UCLASS()
+class FORESTGENERATOR_API UForestGeneratorCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UForestGeneratorCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	/**
+	 * @brief Writes the branches of every plant in a simulation to a CSV file.
+	 * @param Manager The manager holding the finished simulation
+	 * @param Filename The file to write to
+	 * @return If the file was written
+	 */
+	static bool SaveBranches(const class UManager* Manager, const FString& Filename);
+};
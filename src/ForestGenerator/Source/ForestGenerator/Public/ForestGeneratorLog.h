@@ -1,7 +0,0 @@
-// Ollie Nicholls, 2021
-
-#pragma once
-
-#include "CoreMinimal.h"
-
-DECLARE_LOG_CATEGORY_EXTERN(LogForestGenerator, Log, All);
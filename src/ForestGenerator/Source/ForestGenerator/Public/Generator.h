@@ -6,6 +6,8 @@
 #include "GameFramework/Actor.h"
 
 #include "BranchModule.h"
+#include "BranchModuleManager.h"
+#include "Manager.h"
 #include "Plant.h"
 
 #include "Generator.generated.h"
@@ -35,6 +37,27 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "ForestGen|Generator")
 	void Simulate();
 
+	/**
+	 * @brief Simulates the forest on a worker thread, rendering it once it has finished.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Generator")
+	void SimulateAsync();
+
+	/**
+	 * @brief Simulates the forest a little each tick on the game thread, rendering it once it has finished.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Generator")
+	void SimulateTimeSliced();
+
+	/**
+	 * @brief Stops a forest being simulated on a worker thread or time sliced, it is not rendered.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Generator")
+	void CancelSimulation();
+
+	UFUNCTION(BlueprintPure, Category = "ForestGen|Generator")
+	FSimulationProgress GetSimulationProgress() const;
+
 protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Generator")
 	class UBillboardComponent* BillboardComponent;
@@ -42,6 +65,31 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Generator")
 	UManager* ManagerComponent;
 
+	/**
+	* @brief How the forest is simulated when play begins
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	ESimulationMode SimulationMode = ESimulationMode::Blocking;
+
+	/**
+	* @brief If a forest grown from the same settings is loaded from the cache instead of being simulated again, and
+	* newly simulated forests are saved to it
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	bool bUseCache = false;
+
+	/**
+	* @brief Where cached forests are saved, the project's saved directory when empty
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator", meta = (EditCondition = "bUseCache"))
+	FString CacheDirectory;
+
+	/**
+	* @brief How many milliseconds each tick can spend simulating when time sliced
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator", meta = (ClampMin = "0.0"))
+	float TimeSliceBudget = 5.f;
+
 	/**
 	 * @brief The starting number of plants that are spawned
 	 */
@@ -56,6 +104,18 @@ protected:
 		meta = (ClampMin = "1", ClampMax = "100"))
 	int32 MaxNumberOfPlants = 100;
 
+	/**
+	* @brief The maximum number of branch modules a single plant can have
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator", meta = (ClampMin = "1"))
+	int32 MaxModulesPerPlant = 1000;
+
+	/**
+	* @brief The maximum number of branch modules the whole forest can have
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator", meta = (ClampMin = "1"))
+	int32 MaxModules = 100000;
+
 	/**
 	* @brief The maximum time the simulations runs for
 	*/
@@ -93,4 +153,52 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator",
 		meta = (ClampMin = "10.0", ClampMax = "4300.0"))
 	float Precipitation = 1392.0f;
+
+	/**
+	* @brief The seed of the simulation, the same seed always grows the same forest
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	int32 Seed = 0;
+
+	/**
+	* @brief If the light exposures are calculated across worker threads
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	bool bParallelLightExposures = true;
+
+	/**
+	* @brief If the plants are simulated across worker threads
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	bool bParallelPlants = false;
+
+	/**
+	* @brief How the light exposures are calculated
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator")
+	ELightExposureModel LightExposureModel = ELightExposureModel::SphereIntersection;
+
+	/**
+	* @brief The width of a voxel when using shadow propagation
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator", meta = (ClampMin = "1.0"))
+	float ShadowVoxelSize = 20.f;
+
+	/**
+	* @brief How much shadow is kept per voxel it moves down when using shadow propagation
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen|Generator",
+		meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float ShadowFalloff = 0.8f;
+
+private:
+	/**
+	 * @brief Clamps the properties and builds the settings for the manager from them.
+	 */
+	FSimulationSettings GetSimulationSettings();
+
+	FString GetCacheDirectory() const;
+
+	UFUNCTION()
+	void OnSimulationFinished(bool bCancelled);
 };
@@ -3,14 +3,32 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Async.h"
 #include "Components/ActorComponent.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
 
 #include "BranchModule.h"
 #include "BranchModuleManager.h"
+#include "SpeciesTable.h"
 
 
 #include "Manager.generated.h"
 
+/**
+ * @brief How a forest is simulated.
+ */
+UENUM(BlueprintType)
+enum class ESimulationMode : uint8
+{
+	/** All at once on the game thread, blocking it until done */
+	Blocking UMETA(DisplayName = "Blocking"),
+	/** On a worker thread, handing the result back to the game thread once done */
+	Async UMETA(DisplayName = "Async"),
+	/** On the game thread, a few plants at a time each tick within a time budget */
+	TimeSliced UMETA(DisplayName = "Time Sliced")
+};
+
 USTRUCT(BlueprintType)
 struct FSimulationSettings
 {
@@ -34,6 +52,67 @@ struct FSimulationSettings
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen")
 	float Precipitation = 1392.0f;
 
+	/**
+	 * @brief The most branch modules a single plant can have.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "1"))
+	int32 MaxModulesPerPlant = 1000;
+
+	/**
+	 * @brief The most branch modules the whole forest can have.
+	 * When this is close to being reached, what is left is shared out evenly between the plants at the start of each
+	 * step.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "1"))
+	int32 MaxModules = 100000;
+
+	/**
+	 * @brief The seed the random streams of every plant and branch module are derived from.
+	 * The same seed and settings always give the same forest.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen")
+	int32 Seed = 0;
+
+	/**
+	 * @brief If the light exposures of the branch modules are calculated across worker threads.
+	 * Gives the same results as calculating them on the game thread.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen")
+	bool bParallelLightExposures = true;
+
+	/**
+	 * @brief If the plants are simulated across worker threads.
+	 * Each plant has its own random streams and module budget so this gives the same results as simulating them on the
+	 * game thread.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen")
+	bool bParallelPlants = false;
+
+	/**
+	 * @brief How the light exposures of the branch modules are calculated.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen")
+	ELightExposureModel LightExposureModel = ELightExposureModel::SphereIntersection;
+
+	/**
+	 * @brief The width of a voxel when using shadow propagation.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "1.0"))
+	float ShadowVoxelSize = 20.f;
+
+	/**
+	 * @brief How much of the shadow is kept per voxel it moves down when using shadow propagation.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float ShadowFalloff = 0.8f;
+
+	/**
+	 * @brief How many milliseconds a time sliced simulation can take each tick.
+	 * At least one plant is simulated every tick so the simulation always progresses.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "0.0"))
+	float TimeSliceBudget = 5.f;
+
 	FSimulationSettings() = default;
 
 	FSimulationSettings(const int32 NumberOfPlants, const int32 MaxNumberOfPlants, const int32 Time,
@@ -46,8 +125,58 @@ struct FSimulationSettings
 		  Precipitation(Precipitation)
 	{
 	}
+
+	friend FArchive& operator<<(FArchive& Ar, FSimulationSettings& Settings)
+	{
+		Ar << Settings.NumberOfPlants << Settings.MaxNumberOfPlants << Settings.Time << Settings.TimeStep;
+		Ar << Settings.Temperature << Settings.Precipitation << Settings.Seed << Settings.bParallelLightExposures;
+		Ar << Settings.bParallelPlants << Settings.LightExposureModel << Settings.ShadowVoxelSize;
+		Ar << Settings.ShadowFalloff << Settings.TimeSliceBudget << Settings.MaxModulesPerPlant << Settings.MaxModules;
+		return Ar;
+	}
 };
 
+/**
+ * @brief How far through a simulation the manager is.
+ */
+USTRUCT(BlueprintType)
+struct FSimulationProgress
+{
+	GENERATED_BODY()
+
+	/**
+	 * @brief The number of simulation steps completed.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen")
+	int32 Step = 0;
+
+	/**
+	 * @brief The time simulated so far.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen")
+	int32 SimulatedTime = 0;
+
+	/**
+	 * @brief The time the simulation runs for.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen")
+	int32 Time = 0;
+
+	/**
+	 * @brief The number of plants still alive.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen")
+	int32 NumberOfPlants = 0;
+
+	/**
+	 * @brief The number of branch modules across all the plants.
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen")
+	int32 NumberOfModules = 0;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSimulationFinishedSignature, bool, bCancelled);
+
 /**
  * Tracks trees
  * stores ecosystem params
@@ -66,6 +195,9 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	// Called when the game ends, waits for any background simulation to stop
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType,
@@ -81,6 +213,131 @@ public:
 	              const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
 	              class UDataTable* PlantTypes);
 
+	/**
+	 * @brief Initializes the simulation on the game thread then simulates it on a worker thread.
+	 * The plants and modules must not be used until OnSimulationFinished is broadcast, which happens on the game thread
+	 * in the first tick after the simulation is done.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	void SimulateAsync(const FSimulationSettings& Settings,
+	                   const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+	                   class UDataTable* PlantTypes);
+
+	/**
+	 * @brief Initializes the simulation then simulates as much of it as fits in the time slice budget every tick,
+	 * carrying on from the plant it stopped at. OnSimulationFinished is broadcast once it is done.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	void SimulateTimeSliced(const FSimulationSettings& Settings,
+	                        const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+	                        class UDataTable* PlantTypes);
+
+	/**
+	 * @brief Simulates the current simulation until it is done or the time budget runs out, at least one plant is
+	 * always simulated.
+	 * @param Budget The time budget in milliseconds
+	 * @return If the simulation is done
+	 */
+	bool SimulateSlice(const float Budget);
+
+	/**
+	 * @brief Carries on the current simulation, such as one loaded from a checkpoint.
+	 * @param Time The time to simulate up to, including the time already simulated
+	 * @param Mode How to simulate the rest of the time
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	void ResumeSimulation(const int32 Time, const ESimulationMode Mode = ESimulationMode::Blocking);
+
+	/**
+	 * @brief Saves the whole state of the simulation to a binary checkpoint file.
+	 * Can't be done while simulating in the background.
+	 * @param Filename The file to save to
+	 * @return If the checkpoint was saved
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	bool SaveCheckpoint(const FString& Filename);
+
+	/**
+	 * @brief Replaces the simulation with one loaded from a binary checkpoint file, ready to be resumed.
+	 * @param Filename The file to load from
+	 * @param BranchModulePrototypes The prototypes the checkpointed simulation was using
+	 * @return If the checkpoint was loaded, the current simulation is left as it was otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	bool LoadCheckpoint(const FString& Filename, const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes);
+
+	/**
+	 * @brief Saves the whole state of the simulation to a binary checkpoint in memory.
+	 * @param OutData The checkpoint
+	 * @return If the checkpoint was saved
+	 */
+	bool SaveCheckpointToMemory(TArray<uint8>& OutData);
+
+	/**
+	 * @brief Replaces the simulation with one loaded from a binary checkpoint in memory, ready to be resumed.
+	 * @param Data The checkpoint
+	 * @param BranchModulePrototypes The prototypes the checkpointed simulation was using
+	 * @return If the checkpoint was loaded, the current simulation is left as it was otherwise
+	 */
+	bool LoadCheckpointFromMemory(const TArray<uint8>& Data,
+	                              const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes);
+
+	/**
+	 * @brief Get the key of a simulation in the cache, a hash of everything that changes the forest that is grown.
+	 */
+	static FString GetCacheKey(const FSimulationSettings& Settings,
+	                           const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+	                           class UDataTable* PlantTypes);
+
+	/**
+	 * @brief Replaces the simulation with the finished one in the cache with the same inputs, if there is one.
+	 * @param CacheDirectory Where the cached simulations are saved
+	 * @return If a cached simulation was loaded
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	bool LoadFromCache(const FString& CacheDirectory, const FSimulationSettings& Settings,
+	                   const TArray<TSubclassOf<UBranchModule>>& BranchModulePrototypes,
+	                   class UDataTable* PlantTypes);
+
+	/**
+	 * @brief Saves the finished simulation in the cache, keyed by the inputs it was initialized with.
+	 * @param CacheDirectory Where the cached simulations are saved
+	 * @return If the simulation was saved
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	bool SaveToCache(const FString& CacheDirectory);
+
+	/**
+	 * @brief Stops a background or time sliced simulation, leaving the plants as they were grown so far.
+	 * A background simulation stops after the step it is on.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
+	void CancelSimulation();
+
+	/**
+	 * @brief If a background or time sliced simulation is in progress.
+	 */
+	UFUNCTION(BlueprintPure, Category = "ForestGen|Manager")
+	bool IsSimulating() const;
+
+	/**
+	 * @brief If a background simulation is running or waiting to be handed back to the game thread.
+	 */
+	UFUNCTION(BlueprintPure, Category = "ForestGen|Manager")
+	bool IsSimulatingAsync() const;
+
+	/**
+	 * @brief Get how far through the current simulation the manager is, safe to call while simulating in the
+	 * background.
+	 */
+	UFUNCTION(BlueprintPure, Category = "ForestGen|Manager")
+	FSimulationProgress GetSimulationProgress() const;
+
+	/**
+	 * @brief Get the plants in the simulation, including dead ones until the next step filters them out.
+	 */
+	const TArray<class UPlant*>& GetPlants() const;
+
 	UFUNCTION(BlueprintCallable, Category = "ForestGen|Manager")
 	void Render();
 
@@ -96,4 +353,115 @@ protected:
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Manager")
 	UBranchModuleManager* ModuleManager;
+
+public:
+	/**
+	 * @brief Broadcast on the game thread once a background or time sliced simulation has finished or been cancelled.
+	 */
+	UPROPERTY(BlueprintAssignable, Category = "ForestGen|Manager")
+	FSimulationFinishedSignature OnSimulationFinished;
+
+private:
+	/**
+	 * @brief The settings of the current simulation.
+	 */
+	FSimulationSettings SimulationSettings;
+
+	/**
+	 * @brief The settings of every plant type, shared by the plants of the current simulation.
+	 * Held by pointer so a checkpoint can load a new table without touching the one the current plants use.
+	 */
+	TSharedPtr<FSpeciesTable> Species;
+
+	/**
+	 * @brief The time simulated so far in the current simulation.
+	 */
+	int32 SimulatedTime = 0;
+
+	/**
+	 * @brief The key of the current simulation in the cache.
+	 */
+	FString CacheKey;
+
+	/**
+	 * @brief The next plant to simulate in the current step, INDEX_NONE if the step has not started.
+	 */
+	int32 NextPlant = INDEX_NONE;
+
+	/**
+	 * @brief How many modules each plant can attach in the current step, in the same order as Plants.
+	 */
+	TArray<int32> PlantModuleBudgets;
+
+	/**
+	 * @brief If a time sliced simulation is in progress.
+	 */
+	bool bTimeSliced = false;
+
+	/**
+	 * @brief The background simulation, not valid when there isn't one.
+	 */
+	TFuture<void> AsyncSimulation;
+
+	FThreadSafeBool bCancelRequested;
+
+	// The progress is kept in counters so the game thread can read it while a worker thread is simulating
+	FThreadSafeCounter ProgressStep;
+	FThreadSafeCounter ProgressSimulatedTime;
+	FThreadSafeCounter ProgressNumberOfPlants;
+	FThreadSafeCounter ProgressNumberOfModules;
+
+	/**
+	 * @brief If the current simulation has simulated all its time.
+	 */
+	bool IsSimulationComplete() const;
+
+	/**
+	 * @brief Simulates the rest of the current simulation.
+	 * @param Mode Blocks until done, starts a worker thread or starts time slicing
+	 */
+	void RunSimulation(const ESimulationMode Mode);
+
+	/**
+	 * @brief Simulates the next step of the current simulation.
+	 */
+	void SimulateStep();
+
+	/**
+	 * @brief Starts the next step by calculating the light exposures and module budgets.
+	 */
+	void BeginStep();
+
+	/**
+	 * @brief Shares out the modules the plants can attach this step.
+	 * Every plant gets the same share of what is left of the forest's budget at the start of the step, limited by what
+	 * is left of its own budget, so the plants don't depend on the order they are simulated in.
+	 */
+	void CalculateModuleBudgets();
+
+	/**
+	 * @brief Simulates the plant at NextPlant, or all the plants at once when they are simulated in parallel and none
+	 * of them have been simulated yet this step.
+	 */
+	void SimulateNextPlant();
+
+	/**
+	 * @brief Simulates the plants left in a step that was started but not finished, such as one from a checkpoint
+	 * saved part way through a time sliced step, then finishes the step. Does nothing if no step was started.
+	 */
+	void FinishStep();
+
+	/**
+	 * @brief Finishes the current step by removing the plants that have died and moving the time on.
+	 */
+	void EndStep();
+
+	void UpdateProgress();
+
+	/**
+	 * @brief Simulates a single step of every plant.
+	 * @param TimeStep The simulation time step
+	 * @param bParallel If the plants are simulated across worker threads
+	 */
+	void SimulatePlants(const float TimeStep, const bool bParallel);
 };
@@ -12,6 +12,8 @@
 
 class UBranchModule;
 class UBranchModuleManager;
+struct FCheckpointModuleMap;
+struct FSpeciesTable;
 
 USTRUCT(BlueprintType)
 struct FPlantSettings : public FTableRowBase
@@ -143,6 +145,15 @@ struct FPlantSettings : public FTableRowBase
 	*/
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ForestGen", meta = (ClampMin = "0.0", ClampMax = "1.0"))
 	float Straightness = 1.f;
+
+	friend FArchive& operator<<(FArchive& Ar, FPlantSettings& Settings)
+	{
+		Ar << Settings.PMax << Settings.VRootMax << Settings.Gp << Settings.ApicalControl;
+		Ar << Settings.ApicalControlMature << Settings.Determinacy << Settings.DeterminacyMature << Settings.FAge;
+		Ar << Settings.Alpha << Settings.W2 << Settings.G1 << Settings.Phi << Settings.Beta << Settings.VMin;
+		Ar << Settings.VMax << Settings.LMax << Settings.TropismStrength << Settings.Straightness;
+		return Ar;
+	}
 };
 
 UENUM(BlueprintType)
@@ -162,24 +173,55 @@ class FORESTGENERATOR_API UPlant : public UObject
 	GENERATED_BODY()
 
 public:
-	UFUNCTION(BlueprintSetter, Category = "ForestGen|Plant")
-	bool Initialize(UBranchModuleManager* InModuleManager, const FVector& InPosition,
-	                const FPlantSettings& InSettings);
+	/**
+	 * @brief Plants the plant with a root module.
+	 * @param InModuleManager The module manager to track the plant's modules
+	 * @param InPosition Where the plant is planted
+	 * @param InSpecies The species table the plant reads its settings from, it must outlive the plant
+	 * @param InSpeciesID The ID of the plant's species in the table
+	 * @param Seed The seed of the plant's random stream
+	 * @return False if the plant is already initialized or the species is not in the table
+	 */
+	bool Initialize(UBranchModuleManager* InModuleManager, const FVector& InPosition, const FSpeciesTable& InSpecies,
+	                const int32 InSpeciesID, const int32 Seed = 0);
 
 	UFUNCTION(BlueprintGetter, Category = "ForestGen|Plant")
 	EPlantState GetState() const;
 	
 	UFUNCTION(BlueprintCallable, Category = "ForestGen|Plant")
-	void ShedModules(TArray<UBranchModule*> Modules);
+	void ShedModules(const TArray<UBranchModule*>& Modules);
 	
+	/**
+	 * @brief Simulates a single step of the plant.
+	 * @param TimeStep The simulation time step
+	 * @param ModuleBudget How many modules the plant can attach this step
+	 */
 	UFUNCTION(BlueprintCallable, Category = "ForestGen|Plant")
-	void Simulate(const float TimeStep = 1.f);
+	void Simulate(const float TimeStep, const int32 ModuleBudget);
+
+	/**
+	 * @brief Get how many of the plant's modules are still in the simulation.
+	 */
+	UFUNCTION(BlueprintGetter, Category = "ForestGen|Plant")
+	int32 GetNumberOfModules() const;
 
 	UFUNCTION(BlueprintCallable, Category = "ForestGen|Plant")
 	void DrawDebug(const UWorld* WorldContext) const;
 
 	TArray<FBranch> GetBranchTransforms() const;
 
+	UBranchModule* GetRoot() const;
+
+	/**
+	 * @brief Saves or loads the state of the plant for a checkpoint.
+	 * @param Ar The archive
+	 * @param ModuleMap The modules in the checkpoint, already loaded when loading
+	 * @param InModuleManager The module manager tracking the plant's modules, only used when loading
+	 * @param InSpecies The species table the plant reads its settings from, only used when loading
+	 */
+	void SerializeCheckpoint(FArchive& Ar, const FCheckpointModuleMap& ModuleMap, UBranchModuleManager* InModuleManager,
+	                         const FSpeciesTable& InSpecies);
+
 protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
 	UBranchModuleManager* BranchModuleManager;
@@ -196,19 +238,85 @@ protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
 	EPlantState State = EPlantState::Young;
 
+	/**
+	* @brief The modules of the plant in topological order with children before their parents.
+	* This is only sorted again after modules are attached or removed.
+	*/
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
+	TArray<UBranchModule*> SortedModules;
+
+	/**
+	* @brief The index in SortedModules of the first child of each module, INDEX_NONE for modules without children.
+	* Rebuilt along with SortedModules.
+	*/
+	TArray<int32> FirstChildModules;
+
+	/**
+	* @brief The index in SortedModules of the next child of the same parent, INDEX_NONE for the last child.
+	*/
+	TArray<int32> NextSiblingModules;
+
+	/**
+	* @brief The accumulated light exposure of each module in SortedModules, used while calculating vigor.
+	*/
+	TArray<float> ModuleLightExposures;
+
+	/**
+	* @brief The vigor of each module in SortedModules, used while calculating vigor.
+	*/
+	TArray<float> ModuleVigors;
+
+	/**
+	* @brief How much each module in SortedModules ages this step, used while calculating vigor.
+	*/
+	TArray<float> ModuleDeltaAges;
+
 	/**
 	* @brief The physiological age of the plant.
 	*/
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
 	float PT = 0.f;
 
+	/**
+	* @brief The settings of every species, shared by all plants rather than copied into each one.
+	*/
+	const FSpeciesTable* Species = nullptr;
+
+	/**
+	* @brief The index of the plant's species in Species.
+	*/
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
+	int32 SpeciesID = INDEX_NONE;
+
+	/**
+	* @brief The maximum vigor the root can have, starts as the species' VRootMax and falls to zero as the plant ages
+	* past PMax.
+	*/
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
+	float VRootMax = 0.f;
+
+	/**
+	* @brief How many of the plant's modules are still in the simulation, kept up to date as they are attached and
+	* removed.
+	*/
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
+	int32 NumberOfModules = 0;
+
+	/**
+	* @brief The stream the root module's seed is drawn from.
+	*/
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ForestGen|Plant")
-	FPlantSettings Settings;
+	FRandomStream RandomStream;
 
 private:
 	bool bInitialized = false;
 
-	void CalculateVigor();
-	void Grow(const float TimeStep) const;
-	TArray<UBranchModule*> TopologicalSortModules() const;
+	/**
+	* @brief Set when modules are attached or removed and SortedModules needs sorting again.
+	*/
+	bool bSortedModulesDirty = true;
+
+	void CalculateVigor(const float TimeStep);
+	void Grow(const int32 ModuleBudget);
+	const TArray<UBranchModule*>& TopologicalSortModules();
 };
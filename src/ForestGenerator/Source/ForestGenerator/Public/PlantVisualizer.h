@@ -5,6 +5,9 @@
 #include "CoreMinimal.h"
 
 #include "GameFramework/Actor.h"
+
+#include "SpeciesTable.h"
+
 #include "PlantVisualizer.generated.h"
 
 class UBranchModule;
@@ -78,6 +81,11 @@ protected:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = "Forest Generator")
 	UPlant* Plant;
 
+	/**
+	* @brief The plant types compiled for the plant to read its settings from.
+	*/
+	FSpeciesTable Species;
+
 	/**
 	* @brief Bounding box of the InstancedStaticMeshComponent.
 	*/
@@ -0,0 +1,60 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UBranchModule;
+
+/**
+ * @brief Maps the branch modules in a checkpoint to and from their index in it, so the plants, the module manager and
+ * the modules themselves can refer to modules when they are saved and loaded.
+ */
+struct FORESTGENERATOR_API FCheckpointModuleMap
+{
+	/**
+	 * @brief Identifies a checkpoint, the first thing written to one.
+	 */
+	static constexpr uint32 Magic = 0x4B434746;
+
+	/**
+	 * @brief Increased whenever the layout of a checkpoint changes, older checkpoints fail to load.
+	 */
+	static constexpr int32 Version = 5;
+
+	/**
+	 * @brief The modules in the checkpoint in the order they are saved.
+	 */
+	TArray<UBranchModule*> Modules;
+
+	/**
+	 * @brief Adds a module, and all the modules attached to it, if they are not already in the map.
+	 * @param Module The module to add, nullptr is ignored
+	 */
+	void AddWithChildren(UBranchModule* Module);
+
+	/**
+	 * @brief Get the index of a module in the checkpoint.
+	 * @return The index, INDEX_NONE for nullptr or modules that are not in the map
+	 */
+	int32 GetIndex(const UBranchModule* Module) const;
+
+	/**
+	 * @brief Get the module at an index in the checkpoint.
+	 * @return The module, nullptr if the index is not valid
+	 */
+	UBranchModule* GetModule(const int32 Index) const;
+
+	/**
+	 * @brief Saves or loads a reference to a module as its index in the checkpoint.
+	 */
+	void Serialize(FArchive& Ar, UBranchModule*& Module) const;
+
+	/**
+	 * @brief Saves or loads references to modules as their indices in the checkpoint.
+	 */
+	void Serialize(FArchive& Ar, TArray<UBranchModule*>& InModules) const;
+
+private:
+	TMap<const UBranchModule*, int32> Indices;
+};
@@ -0,0 +1,74 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Plant.h"
+
+class UDataTable;
+
+/**
+ * @brief The settings of every plant species in a simulation, compiled once from the rows of a plant types table.
+ * Each parameter is kept in its own array indexed by species ID, so plants only store their species ID and growing a
+ * forest of many species reads the same few arrays as a forest of one. See FPlantSettings for what each parameter
+ * does, the values here are already clamped to their valid ranges.
+ */
+struct FORESTGENERATOR_API FSpeciesTable
+{
+	/**
+	 * @brief The name of the row each species was compiled from.
+	 */
+	TArray<FName> Names;
+
+	TArray<int32> PMax;
+	TArray<float> VRootMax;
+	TArray<float> Gp;
+	TArray<float> ApicalControl;
+	TArray<float> ApicalControlMature;
+	TArray<float> Determinacy;
+	TArray<float> DeterminacyMature;
+	TArray<int32> FAge;
+	TArray<float> Alpha;
+	TArray<float> W2;
+	TArray<float> G1;
+	TArray<float> Phi;
+	TArray<float> Beta;
+	TArray<float> VMin;
+	TArray<float> VMax;
+	TArray<float> LMax;
+	TArray<float> TropismStrength;
+	TArray<float> Straightness;
+
+	/**
+	 * @brief Replaces the species with one for every row of a plant types table, in row order.
+	 * @param PlantTypes The table, with FPlantSettings rows
+	 * @return How many species were compiled
+	 */
+	int32 Compile(const UDataTable* PlantTypes);
+
+	/**
+	 * @brief Adds a species, clamping each of its settings to the valid range.
+	 * @param Name The name of the species
+	 * @param Settings The settings of the species
+	 * @return The ID of the new species
+	 */
+	int32 AddSpecies(const FName Name, const FPlantSettings& Settings);
+
+	/**
+	 * @brief Get the ID of the species compiled from a row.
+	 * @return The ID, INDEX_NONE if there is no species with that name
+	 */
+	int32 FindSpecies(const FName Name) const;
+
+	bool IsValidSpecies(const int32 SpeciesID) const;
+
+	int32 Num() const;
+
+	void Reset();
+
+	/**
+	 * @brief Saves or loads every species, an archive with parameter arrays of different lengths is marked as corrupt.
+	 */
+	friend FArchive& operator<<(FArchive& Ar, FSpeciesTable& Species);
+};
@@ -0,0 +1,19 @@
+// Ollie Nicholls, 2021
+
+using UnrealBuildTool;
+
+public class ForestGeneratorCore : ModuleRules
+{
+	public ForestGeneratorCore(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		// The growth model and graphs only use Core so they can be built into programs without the engine
+		PublicDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"Core",
+			}
+			);
+	}
+}
@@ -0,0 +1,555 @@
+// Ollie Nicholls, 2021
+
+
+#include "BranchGraph.h"
+
+#include "ForestGeneratorLog.h"
+
+namespace
+{
+	/**
+	 * @brief If every value is at least Min and less than Max.
+	 */
+	bool AreAllInRange(const TArray<int32>& Values, const int32 Min, const int32 Max)
+	{
+		for (const int32 Value : Values)
+		{
+			if (Value < Min || Value >= Max)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief If every node type is one of the values of ENodeType.
+	 */
+	bool AreValidTypes(const TArray<ENodeType>& Types)
+	{
+		for (const ENodeType Type : Types)
+		{
+			if (static_cast<uint8>(Type) > static_cast<uint8>(ENodeType::Terminal))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief If the offsets start at zero, never go down and end at the number of values they index.
+	 */
+	bool AreValidOffsets(const TArray<int32>& Offsets, const int32 NumValues)
+	{
+		if (Offsets.Num() < 1 || Offsets[0] != 0 || Offsets.Last() != NumValues)
+		{
+			return false;
+		}
+
+		for (int32 i = 1; i < Offsets.Num(); i++)
+		{
+			if (Offsets[i] < Offsets[i - 1])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+void FBranchGraph::Reset(const int32 NumNodes, const int32 InNumBranches)
+{
+	NumBranches = InNumBranches;
+
+	Offsets.Init(FVector::ZeroVector, NumNodes);
+	Positions.Init(FVector::ZeroVector, NumNodes);
+	Directions.Init(FVector::UpVector, NumNodes);
+	Ages.Init(0.f, NumNodes);
+	Vigors.Init(0.f, NumNodes);
+	LightExposures.Init(0.f, NumNodes);
+	Types.Init(ENodeType::Terminal, NumNodes);
+	ParentBranches.Init(INDEX_NONE, NumNodes);
+	FirstChildBranch.Init(0, NumNodes + 1);
+	ChildBranches.Reset();
+	MainChildren.Init(INDEX_NONE, NumNodes);
+	ChildGraphs.Init(nullptr, NumNodes);
+
+	// Every node gets a connecting segment after the segments from the definition
+	const int32 NumSegments = NumBranches + NumNodes;
+	Sources.Init(INDEX_NONE, NumSegments);
+	Destinations.Init(INDEX_NONE, NumSegments);
+	Diameters.Init(0.f, NumSegments);
+	Available.Init(false, NumSegments);
+	Depths.Init(0, NumSegments);
+
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		Sources[GetConnectionBranch(Node)] = Node;
+	}
+
+	AvailableBranches.Reset();
+	DepthBranches.Reset();
+	FirstDepthBranch.Init(0, 1);
+	NextDepth = 0;
+	SortedNodes.Reset();
+	bSortedNodesDirty = true;
+	ParentGraph = nullptr;
+	ParentNode = INDEX_NONE;
+}
+
+int32 FBranchGraph::GetNumNodes() const
+{
+	return Positions.Num();
+}
+
+void FBranchGraph::MakeAvailable(const int32 Branch)
+{
+	Available[Branch] = true;
+	AvailableBranches.Add(Branch);
+	bSortedNodesDirty = true;
+}
+
+int32 FBranchGraph::GetConnectionBranch(const int32 Node) const
+{
+	return NumBranches + Node;
+}
+
+FBranchGraph* FBranchGraph::GetDestination(const int32 Branch, int32& OutNode)
+{
+	if (Branch < NumBranches)
+	{
+		OutNode = Destinations[Branch];
+		return this;
+	}
+
+	OutNode = RootNode;
+	return ChildGraphs[Sources[Branch]];
+}
+
+bool FBranchGraph::ConnectChildGraph(const int32 Node, FBranchGraph* ChildGraph)
+{
+	ChildGraph->ParentGraph = this;
+	ChildGraph->ParentNode = Node;
+
+	if (Types[Node] != ENodeType::Terminal)
+	{
+		UE_LOG(LogForestGenerator, Verbose,
+		       TEXT("Branch Node[%d]: Cannot add new module to this node as not terminal."), Node);
+		return false;
+	}
+
+	Types[Node] = ENodeType::Connecting;
+	ChildGraphs[Node] = ChildGraph;
+	ChildGraph->Offsets[RootNode] -= Positions[Node];
+	Diameters[GetConnectionBranch(Node)] = 0.f;
+
+	return true;
+}
+
+void FBranchGraph::DisconnectChildGraph(const int32 Node)
+{
+	AvailableBranches.Remove(GetConnectionBranch(Node));
+	ChildGraphs[Node] = nullptr;
+	Types[Node] = ENodeType::Terminal;
+}
+
+void FBranchGraph::Translate(const int32 Node, const FVector& Translation)
+{
+	Offsets[Node] += Translation;
+	Positions[Node] += Translation;
+}
+
+void FBranchGraph::SetOffset(const int32 Node, const FVector& Offset)
+{
+	Offsets[Node] = Offset;
+	Positions[Node] = GetParentPosition(Node) + Offset;
+}
+
+void FBranchGraph::ResolvePositions(const bool bIncludeChildGraphs)
+{
+	Positions[RootNode] = Offsets[RootNode];
+
+	if (ParentGraph != nullptr)
+	{
+		Positions[RootNode] += ParentGraph->Positions[ParentNode];
+	}
+
+	ResolveChildPositions(RootNode, bIncludeChildGraphs);
+}
+
+void FBranchGraph::ResolveChildPositions(const int32 Node, const bool bIncludeChildGraphs)
+{
+	if (Types[Node] == ENodeType::Connecting)
+	{
+		if (bIncludeChildGraphs)
+		{
+			ChildGraphs[Node]->ResolvePositions(true);
+		}
+
+		return;
+	}
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		const int32 ChildBranch = ChildBranches[i];
+
+		if (Available[ChildBranch])
+		{
+			const int32 Child = Destinations[ChildBranch];
+			Positions[Child] = Positions[Node] + Offsets[Child];
+			ResolveChildPositions(Child, bIncludeChildGraphs);
+		}
+	}
+}
+
+FVector FBranchGraph::GetWorldPosition(const int32 Node) const
+{
+	if (Node == RootNode)
+	{
+		return ParentGraph != nullptr
+			       ? ParentGraph->GetWorldPosition(ParentNode) + Offsets[RootNode]
+			       : Offsets[RootNode];
+	}
+
+	if (ParentBranches[Node] == INDEX_NONE)
+	{
+		return Offsets[Node];
+	}
+
+	return GetWorldPosition(Sources[ParentBranches[Node]]) + Offsets[Node];
+}
+
+void FBranchGraph::IncreaseAge(const int32 Node, const float DeltaAge)
+{
+	Ages[Node] += DeltaAge;
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		const int32 ChildBranch = ChildBranches[i];
+
+		if (Available[ChildBranch])
+		{
+			IncreaseAge(Destinations[ChildBranch], DeltaAge);
+		}
+	}
+}
+
+void FBranchGraph::RecalculateDirection(const int32 Node)
+{
+	if (HasParent(Node))
+	{
+		Directions[Node] = Offsets[Node].GetSafeNormal();
+	}
+}
+
+void FBranchGraph::SetDirection(const int32 Node, const FRotator& Rotator)
+{
+	Directions[Node] = Rotator.RotateVector(Directions[Node]);
+}
+
+bool FBranchGraph::HasParent(const int32 Node) const
+{
+	return (Node == RootNode && ParentGraph != nullptr) || ParentBranches[Node] != INDEX_NONE;
+}
+
+FVector FBranchGraph::GetParentPosition(const int32 Node) const
+{
+	if (Node == RootNode && ParentGraph != nullptr)
+	{
+		return ParentGraph->Positions[ParentNode];
+	}
+
+	if (ParentBranches[Node] == INDEX_NONE)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Branch Node[%d]: Parent not set."), Node);
+		return FVector::ZeroVector;
+	}
+
+	return Positions[Sources[ParentBranches[Node]]];
+}
+
+bool FBranchGraph::IsParentBranchAvailable(const int32 Node) const
+{
+	// Connecting segments are never made available
+	if (Node == RootNode && ParentGraph != nullptr)
+	{
+		return false;
+	}
+
+	return ParentBranches[Node] != INDEX_NONE && Available[ParentBranches[Node]];
+}
+
+float FBranchGraph::GetParentBranchDiameter(const int32 Node) const
+{
+	if (Node == RootNode && ParentGraph != nullptr)
+	{
+		return ParentGraph->Diameters[ParentGraph->GetConnectionBranch(ParentNode)];
+	}
+
+	if (ParentBranches[Node] == INDEX_NONE)
+	{
+		UE_LOG(LogForestGenerator, Warning, TEXT("Branch Node[%d]: Parent not set."), Node);
+		return 0.f;
+	}
+
+	return Diameters[ParentBranches[Node]];
+}
+
+float FBranchGraph::GetParentBranchLength(const int32 Node) const
+{
+	if (HasParent(Node))
+	{
+		return Offsets[Node].Size();
+	}
+
+	return 0.f;
+}
+
+void FBranchGraph::GetAvailableChildrenBranches(const int32 Node, TArray<int32>& OutBranches) const
+{
+	OutBranches.Reset();
+
+	if (Types[Node] == ENodeType::Connecting)
+	{
+		OutBranches.Add(GetConnectionBranch(Node));
+		return;
+	}
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		if (Available[ChildBranches[i]])
+		{
+			OutBranches.Add(ChildBranches[i]);
+		}
+	}
+}
+
+void FBranchGraph::GetChildren(const int32 Node, TArray<int32>& OutChildren) const
+{
+	OutChildren.Reset();
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		OutChildren.Add(Destinations[ChildBranches[i]]);
+	}
+}
+
+void FBranchGraph::CalculateMainChildren()
+{
+	const int32 NumNodes = GetNumNodes();
+	MainChildren.Init(INDEX_NONE, NumNodes);
+
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+		{
+			const int32 Child = Destinations[ChildBranches[i]];
+
+			if (MainChildren[Node] == INDEX_NONE || Child < MainChildren[Node])
+			{
+				MainChildren[Node] = Child;
+			}
+		}
+	}
+}
+
+void FBranchGraph::CalculateDepthOrder()
+{
+	DepthBranches = ChildBranches;
+	DepthBranches.Sort([this](const int32 A, const int32 B)
+	{
+		return Depths[A] < Depths[B] || (Depths[A] == Depths[B] && A < B);
+	});
+
+	const int32 NumDepths = DepthBranches.Num() > 0 ? Depths[DepthBranches.Last()] + 1 : 0;
+	FirstDepthBranch.Init(0, NumDepths + 1);
+
+	for (const int32 Branch : DepthBranches)
+	{
+		FirstDepthBranch[Depths[Branch] + 1]++;
+	}
+
+	for (int32 Depth = 0; Depth < NumDepths; Depth++)
+	{
+		FirstDepthBranch[Depth + 1] += FirstDepthBranch[Depth];
+	}
+
+	// Segments are made available a whole depth at a time, so the first one not available marks the next depth
+	NextDepth = NumDepths;
+
+	for (const int32 Branch : DepthBranches)
+	{
+		if (!Available[Branch])
+		{
+			NextDepth = Depths[Branch];
+			break;
+		}
+	}
+}
+
+void FBranchGraph::TopologicalSort(TArray<int32>& OutSortedNodes) const
+{
+	OutSortedNodes.Reset();
+
+	TArray<ENodeSortMark> SortMarks;
+	SortMarks.Init(ENodeSortMark::None, GetNumNodes());
+
+	Visit(RootNode, SortMarks, OutSortedNodes);
+}
+
+const TArray<int32>& FBranchGraph::GetSortedNodes()
+{
+	if (bSortedNodesDirty)
+	{
+		TopologicalSort(SortedNodes);
+		bSortedNodesDirty = false;
+	}
+
+	return SortedNodes;
+}
+
+void FBranchGraph::Visit(const int32 Node, TArray<ENodeSortMark>& SortMarks, TArray<int32>& OutSortedNodes) const
+{
+	if (SortMarks[Node] == ENodeSortMark::Permanent)
+	{
+		return;
+	}
+
+	if (SortMarks[Node] == ENodeSortMark::Temporary)
+	{
+		// This should be impossible so very bad here
+		UE_LOG(LogForestGenerator, Fatal, TEXT("Branch Module: Branch module graph is not a DAG!"));
+	}
+
+	SortMarks[Node] = ENodeSortMark::Temporary;
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		const int32 ChildBranch = ChildBranches[i];
+
+		if (Available[ChildBranch])
+		{
+			Visit(Destinations[ChildBranch], SortMarks, OutSortedNodes);
+		}
+	}
+
+	SortMarks[Node] = ENodeSortMark::Permanent;
+	OutSortedNodes.Add(Node);
+}
+
+void FBranchGraph::GetBranchTransforms(const int32 Node, TArray<FBranchSegment>& OutBranches) const
+{
+	AppendBranchTransforms(Node, GetWorldPosition(Node), OutBranches);
+}
+
+void FBranchGraph::AppendBranchTransforms(const int32 Node, const FVector& Position,
+                                          TArray<FBranchSegment>& OutBranches) const
+{
+	if (Types[Node] == ENodeType::Connecting)
+	{
+		const FBranchGraph* ChildGraph = ChildGraphs[Node];
+		const FVector ChildPosition = Position + ChildGraph->Offsets[RootNode];
+		OutBranches.Add(FBranchSegment{Position, ChildPosition, ChildGraph->GetParentBranchDiameter(RootNode)});
+		ChildGraph->AppendBranchTransforms(RootNode, ChildPosition, OutBranches);
+		return;
+	}
+
+	for (int32 i = FirstChildBranch[Node]; i < FirstChildBranch[Node + 1]; i++)
+	{
+		const int32 ChildBranch = ChildBranches[i];
+
+		if (Available[ChildBranch])
+		{
+			const int32 Child = Destinations[ChildBranch];
+			const FVector ChildPosition = Position + Offsets[Child];
+			OutBranches.Add(FBranchSegment{Position, ChildPosition, GetParentBranchDiameter(Child)});
+			AppendBranchTransforms(Child, ChildPosition, OutBranches);
+		}
+	}
+}
+
+bool FBranchGraph::IsRoot(const int32 Node) const
+{
+	return Types[Node] == ENodeType::Root;
+}
+
+bool FBranchGraph::IsTerminal(const int32 Node) const
+{
+	return Types[Node] == ENodeType::Terminal;
+}
+
+bool FBranchGraph::IsConnecting(const int32 Node) const
+{
+	return Types[Node] == ENodeType::Connecting;
+}
+
+FArchive& operator<<(FArchive& Ar, FBranchGraph& Graph)
+{
+	Ar << Graph.NumBranches;
+	Ar << Graph.ParentNode;
+
+	Ar << Graph.Offsets;
+	Ar << Graph.Positions;
+	Ar << Graph.Directions;
+	Ar << Graph.Ages;
+	Ar << Graph.Vigors;
+	Ar << Graph.LightExposures;
+	Ar << Graph.Types;
+	Ar << Graph.ParentBranches;
+	Ar << Graph.FirstChildBranch;
+	Ar << Graph.ChildBranches;
+
+	Ar << Graph.Sources;
+	Ar << Graph.Destinations;
+	Ar << Graph.Diameters;
+	Ar << Graph.Available;
+	Ar << Graph.Depths;
+	Ar << Graph.AvailableBranches;
+
+	if (Ar.IsLoading())
+	{
+		const int32 NumNodes = Graph.GetNumNodes();
+		const int32 NumSegments = Graph.NumBranches + NumNodes;
+
+		// Anything out of line would read out of bounds while simulating, so treat it as corrupt
+		if (Graph.NumBranches < 0 || NumNodes < 1 || Graph.Offsets.Num() != NumNodes ||
+			Graph.Directions.Num() != NumNodes || Graph.Ages.Num() != NumNodes || Graph.Vigors.Num() != NumNodes ||
+			Graph.LightExposures.Num() != NumNodes || Graph.Types.Num() != NumNodes ||
+			Graph.ParentBranches.Num() != NumNodes || Graph.FirstChildBranch.Num() != NumNodes + 1 ||
+			Graph.Sources.Num() != NumSegments || Graph.Destinations.Num() != NumSegments ||
+			Graph.Diameters.Num() != NumSegments || Graph.Available.Num() != NumSegments ||
+			Graph.Depths.Num() != NumSegments)
+		{
+			Ar.SetError();
+		}
+		// The indices are followed when working out the main children and depth order, and while simulating, so any
+		// outside the graph are corrupt too, as are unknown node types. A node is never deeper than the number of
+		// nodes.
+		else if (Graph.ParentNode < INDEX_NONE || !AreValidTypes(Graph.Types) ||
+			!AreValidOffsets(Graph.FirstChildBranch, Graph.ChildBranches.Num()) ||
+			!AreAllInRange(Graph.ChildBranches, 0, Graph.NumBranches) ||
+			!AreAllInRange(Graph.ParentBranches, INDEX_NONE, NumSegments) ||
+			!AreAllInRange(Graph.AvailableBranches, 0, NumSegments) ||
+			!AreAllInRange(Graph.Sources, INDEX_NONE, NumNodes) ||
+			!AreAllInRange(Graph.Destinations, INDEX_NONE, NumNodes) || !AreAllInRange(Graph.Depths, 0, NumNodes))
+		{
+			Ar.SetError();
+		}
+		else
+		{
+			Graph.CalculateMainChildren();
+			Graph.CalculateDepthOrder();
+		}
+
+		Graph.ChildGraphs.Init(nullptr, NumNodes);
+		Graph.SortedNodes.Reset();
+		Graph.bSortedNodesDirty = true;
+		Graph.ParentGraph = nullptr;
+	}
+
+	return Ar;
+}
@@ -0,0 +1,156 @@
+// Ollie Nicholls, 2021
+
+
+#include "BranchModuleTemplate.h"
+
+#include "ForestGeneratorLog.h"
+
+bool FBranchModuleTemplate::Compile(const TArray<TPair<int32, int32>>& Edges)
+{
+	if (Edges.Num() < 1)
+	{
+		UE_LOG(LogForestGenerator, Fatal,
+		       TEXT("Branch Module Template: Invalid Definition: Graph must have at least 1 edge."));
+		return false;
+	}
+
+	// Reshuffle IDs so start at 0
+	TSortedMap<int32, int32> NodesMap;
+
+	for (const TPair<int32, int32>& Edge : Edges)
+	{
+		if (Edge.Key == Edge.Value)
+		{
+			UE_LOG(LogForestGenerator, Fatal,
+			       TEXT("Branch Module Template: Invalid Definition: The Source and Destination ID are the same: [%d]."),
+			       Edge.Key);
+			return false;
+		}
+
+		NodesMap.Add(Edge.Key, INDEX_NONE);
+		NodesMap.Add(Edge.Value, INDEX_NONE);
+	}
+
+	int32 NextID = 0;
+	for (TPair<int32, int32>& Pair : NodesMap)
+	{
+		Pair.Value = NextID++;
+	}
+
+	const int32 NumNodes = NodesMap.Num();
+	Graph.Reset(NumNodes, Edges.Num());
+
+	// Count the children of each node first so they can be packed together in ChildBranches
+	TArray<int32> NumChildren;
+	NumChildren.Init(0, NumNodes);
+
+	for (int32 Branch = 0; Branch < Edges.Num(); Branch++)
+	{
+		const int32 Source = NodesMap.FindChecked(Edges[Branch].Key);
+		const int32 Destination = NodesMap.FindChecked(Edges[Branch].Value);
+
+		Graph.Sources[Branch] = Source;
+		Graph.Destinations[Branch] = Destination;
+		Graph.ParentBranches[Destination] = Branch;
+
+		if (NumChildren[Source] < FBranchGraph::MaxChildren)
+		{
+			NumChildren[Source]++;
+			Graph.Types[Source] = ENodeType::Normal;
+
+			UE_LOG(LogForestGenerator, Verbose,
+			       TEXT("Branch Module Template: Edge added from Parent [%d] to Child [%d]"), Edges[Branch].Key,
+			       Edges[Branch].Value);
+		}
+		else
+		{
+			UE_LOG(LogForestGenerator, Warning,
+			       TEXT("Branch Module Template: Node [%d] already has max children, no new child added."),
+			       Edges[Branch].Key);
+		}
+	}
+
+	for (int32 Node = 0; Node < NumNodes; Node++)
+	{
+		Graph.FirstChildBranch[Node + 1] = Graph.FirstChildBranch[Node] + NumChildren[Node];
+	}
+
+	Graph.ChildBranches.SetNumUninitialized(Graph.FirstChildBranch[NumNodes]);
+	NumChildren.Init(0, NumNodes);
+
+	for (int32 Branch = 0; Branch < Edges.Num(); Branch++)
+	{
+		const int32 Source = Graph.Sources[Branch];
+
+		if (Graph.FirstChildBranch[Source] + NumChildren[Source] < Graph.FirstChildBranch[Source + 1])
+		{
+			Graph.ChildBranches[Graph.FirstChildBranch[Source] + NumChildren[Source]++] = Branch;
+		}
+	}
+
+	Graph.CalculateMainChildren();
+
+	Graph.Types[FBranchGraph::RootNode] = ENodeType::Root;
+
+	// We now have an array of nodes all with their edges
+	// Need to check graph is connected now
+	// We will do this by doing a breadth first search of the graph and then checking that all nodes are discovered
+	// Taken from https://en.wikipedia.org/wiki/Breadth-first_search
+	// And the depth calculation is from https://stackoverflow.com/a/43524835
+	TQueue<int32> Queue;
+	TBitArray<> Discovered{false, NumNodes};
+	int32 NumDiscovered = 0;
+	int32 Depth = 0;
+
+	// Add the root to discovered and the queue, INDEX_NONE marks the end of each level
+	int32 Node = FBranchGraph::RootNode;
+	Discovered[Node] = true;
+	NumDiscovered++;
+	Queue.Enqueue(Node);
+	Queue.Enqueue(INDEX_NONE);
+
+	while (!Queue.IsEmpty())
+	{
+		if (Queue.Dequeue(Node))
+		{
+			if (Node == INDEX_NONE)
+			{
+				Queue.Enqueue(INDEX_NONE);
+				if (Queue.Peek() == nullptr || *Queue.Peek() == INDEX_NONE)
+				{
+					break;
+				}
+
+				Depth++;
+				continue;
+			}
+			for (int32 i = Graph.FirstChildBranch[Node]; i < Graph.FirstChildBranch[Node + 1]; i++)
+			{
+				const int32 ChildBranch = Graph.ChildBranches[i];
+				Graph.Depths[ChildBranch] = Depth;
+				const int32 Child = Graph.Destinations[ChildBranch];
+				if (!Discovered[Child])
+				{
+					Discovered[Child] = true;
+					NumDiscovered++;
+					Queue.Enqueue(Child);
+				}
+			}
+		}
+	}
+
+	if (NumDiscovered != NumNodes)
+	{
+		UE_LOG(LogForestGenerator, Fatal,
+		       TEXT("Branch Module Template: Invalid Definition: The graph is not connected."));
+		return false;
+	}
+
+	Graph.CalculateDepthOrder();
+
+	// We now have a valid graph!
+	// Minus 1 here as the graph starts with the root and its children
+	AgeMature = static_cast<float>(Depth) - 1;
+
+	return true;
+}
@@ -0,0 +1,5 @@
+// Ollie Nicholls, 2021
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, ForestGeneratorCore)
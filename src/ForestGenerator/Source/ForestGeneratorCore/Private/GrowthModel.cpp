@@ -0,0 +1,361 @@
+// Ollie Nicholls, 2021
+
+
+#include "GrowthModel.h"
+
+#include "BranchGraph.h"
+
+float FGrowthModel::GetMainChildVigor(const float Vigor, const float MainLightExposure,
+                                      const float LateralLightExposure, const float ApicalControl)
+{
+	const float QUM = MainLightExposure;
+	const float QUL = LateralLightExposure;
+	const float Lambda = ApicalControl;
+
+	if (QUM == 0.f)
+	{
+		return 0.f;
+	}
+
+	return Vigor * (Lambda * QUM) / (Lambda * QUM + (1 - Lambda) * QUL);
+}
+
+void FGrowthModel::CalculatePerNodeVigor(FBranchGraph& Graph, const float ApicalControl)
+{
+	// The nodes are kept in a topological order for a basipetal pass
+	const TArray<int32>& SortedNodes = Graph.GetSortedNodes();
+
+	// Accumulate Qu into Qtotal at uroot
+	for (const int32 Node : SortedNodes)
+	{
+		float QU = Graph.LightExposures[Node];
+
+		// Sum up all Qus, a connecting node's only child is the root of its child module
+		if (Graph.IsConnecting(Node))
+		{
+			QU += Graph.ChildGraphs[Node]->LightExposures[FBranchGraph::RootNode];
+		}
+		else
+		{
+			for (int32 i = Graph.FirstChildBranch[Node]; i < Graph.FirstChildBranch[Node + 1]; i++)
+			{
+				QU += Graph.LightExposures[Graph.Destinations[Graph.ChildBranches[i]]];
+			}
+		}
+
+		Graph.LightExposures[Node] = QU;
+	}
+
+	// Go through the list backwards as redistributing in an acropetal pass
+	ensure(SortedNodes.Last() == FBranchGraph::RootNode);
+
+	const float QTotal = Graph.LightExposures[FBranchGraph::RootNode];
+	Graph.Vigors[FBranchGraph::RootNode] = QTotal;
+
+	// Redistribute Vu through plant
+	for (int32 i = SortedNodes.Num() - 1; i >= 0; i--)
+	{
+		const int32 Node = SortedNodes[i];
+		const float VU = Graph.Vigors[Node];
+
+		if (Graph.IsConnecting(Node))
+		{
+			// If the module only has one child, the remaining vigor goes to them
+			Graph.ChildGraphs[Node]->Vigors[FBranchGraph::RootNode] = VU;
+			continue;
+		}
+
+		const int32 FirstChildBranch = Graph.FirstChildBranch[Node];
+		const int32 NumChildren = Graph.FirstChildBranch[Node + 1] - FirstChildBranch;
+
+		if (NumChildren == 1)
+		{
+			// If the module only has one child, the remaining vigor goes to them
+			Graph.Vigors[Graph.Destinations[Graph.ChildBranches[FirstChildBranch]]] = VU;
+		}
+		else if (NumChildren > 1)
+		{
+			// Picked out when the template was compiled, nodes were reshuffled to be in ID order so it is the lowest index
+			const int32 MainChild = Graph.MainChildren[Node];
+
+			const float QUM = Graph.LightExposures[MainChild];
+			const float QUL = Graph.LightExposures[Node] - QUM;
+
+			// Eq 2
+			const float VUM = GetMainChildVigor(VU, QUM, QUL, ApicalControl);
+			const float VUL = VU - VUM;
+
+			for (int32 j = FirstChildBranch; j < FirstChildBranch + NumChildren; j++)
+			{
+				const int32 Child = Graph.Destinations[Graph.ChildBranches[j]];
+				Graph.Vigors[Child] = Child == MainChild ? VUM : VUL;
+			}
+		}
+	}
+}
+
+float FGrowthModel::GetGrowthRate(const float Vigor, const float VMin, const float VMax, const float GP)
+{
+	// Smoothly interpolated sigmoid function, multiplied out the same way as in CalculateDeltaAges
+	auto S = [](const float X) { return 3.f * FMath::Square(X) - 2.f * (FMath::Square(X) * X); };
+
+	return S((Vigor - VMin) / (VMax - VMin)) * GP;
+}
+
+float FGrowthModel::GetDeltaAge(const float GrowthRate, const float DT)
+{
+	// The rate of change of physiological age function (dau/dt = Y(u))
+	return GrowthRate * DT;
+}
+
+void FGrowthModel::CalculateDeltaAges(const TArray<float>& Vigors, TArray<float>& OutDeltaAges, const float VMin,
+                                      const float VMax, const float GP, const float DT)
+{
+	const int32 NumVigors = Vigors.Num();
+	OutDeltaAges.SetNumUninitialized(NumVigors);
+
+	const VectorRegister VMinRegister = VectorSetFloat1(VMin);
+	const VectorRegister VMaxRegister = VectorSetFloat1(VMax);
+	const VectorRegister VRange = VectorSetFloat1(VMax - VMin);
+	const VectorRegister GPRegister = VectorSetFloat1(GP);
+	const VectorRegister DTRegister = VectorSetFloat1(DT);
+	const VectorRegister Two = VectorSetFloat1(2.f);
+	const VectorRegister Three = VectorSetFloat1(3.f);
+
+	int32 i = 0;
+
+	for (; i + 4 <= NumVigors; i += 4)
+	{
+		// Eq 5
+		const VectorRegister Vigor = VectorMin(VectorLoad(&Vigors[i]), VMaxRegister);
+		const VectorRegister X = VectorDivide(VectorSubtract(Vigor, VMinRegister), VRange);
+		const VectorRegister XSquared = VectorMultiply(X, X);
+		const VectorRegister S = VectorSubtract(VectorMultiply(Three, XSquared),
+		                                        VectorMultiply(Two, VectorMultiply(XSquared, X)));
+		const VectorRegister GrowthRate = VectorMultiply(S, GPRegister);
+
+		// Eq 6
+		VectorStore(VectorMultiply(GrowthRate, DTRegister), &OutDeltaAges[i]);
+	}
+
+	// The last few don't fill a register
+	for (; i < NumVigors; i++)
+	{
+		OutDeltaAges[i] = GetDeltaAge(GetGrowthRate(FMath::Min(Vigors[i], VMax), VMin, VMax, GP), DT);
+	}
+}
+
+void FGrowthModel::GrowGraph(FBranchGraph& Graph, const float PhysiologicalAge, const float Straightness,
+                             FRandomStream& RandomStream)
+{
+	const int32 NumDepths = Graph.FirstDepthBranch.Num() - 1;
+	const int32 Depth = static_cast<int32>(PhysiologicalAge);
+
+	TArray<int32> NewParents;
+
+	// The age can pass more than one depth in a step, so each depth is grown in turn and parents are placed before
+	// their children are revealed
+	for (; Graph.NextDepth <= Depth && Graph.NextDepth < NumDepths; Graph.NextDepth++)
+	{
+		NewParents.Reset();
+
+		for (int32 i = Graph.FirstDepthBranch[Graph.NextDepth]; i < Graph.FirstDepthBranch[Graph.NextDepth + 1]; i++)
+		{
+			const int32 Branch = Graph.DepthBranches[i];
+
+			// The children of the root are available from the start
+			if (Graph.Available[Branch])
+			{
+				continue;
+			}
+
+			Graph.MakeAvailable(Branch);
+			Graph.IncreaseAge(Graph.Destinations[Branch], PhysiologicalAge - static_cast<float>(Graph.Depths[Branch]));
+
+			// All the children of a node have the same depth, so each parent is only added for its first child
+			const int32 Parent = Graph.Sources[Branch];
+
+			if (Graph.ChildBranches[Graph.FirstChildBranch[Parent]] == Branch)
+			{
+				NewParents.Add(Parent);
+			}
+		}
+
+		for (const int32 NewParent : NewParents)
+		{
+			SpawnChildNodes(Graph, NewParent, Straightness, RandomStream);
+		}
+	}
+}
+
+void FGrowthModel::SpawnChildNodes(FBranchGraph& Graph, const int32 Parent, const float Straightness,
+                                   FRandomStream& RandomStream)
+{
+	TArray<int32> ChildrenNodes;
+	Graph.GetChildren(Parent, ChildrenNodes);
+	Algo::Reverse(ChildrenNodes);
+	int32 Child;
+
+	const FRotator ParentRotation = Graph.Directions[Parent].ToOrientationRotator() -
+		FVector::UpVector.ToOrientationRotator();
+	FVector Position = FVector::UpVector;
+
+	// Children.Num() can be max of 5
+
+	// If there is an odd number of children one child is always straight up
+	if ((ChildrenNodes.Num() + 1) % 2 == 0)
+	{
+		const FRotator Rotator = FRotator{
+			RandomStream.FRandRange(-10.f, 10.f),
+			0.f,
+			RandomStream.FRandRange(-10.f, 10.f)
+		} * (1.f - Straightness);
+		Child = ChildrenNodes.Pop();
+		Position = Rotator.RotateVector(Position);
+		Position = ParentRotation.RotateVector(Position);
+		Graph.SetOffset(Child, Position);
+		Graph.RecalculateDirection(Child);
+	}
+
+	if (ChildrenNodes.Num() == 0)
+	{
+		return;
+	}
+
+	// This is used to make sure not all the branches come out the same direction for each SpawnChildren call
+	const FRotator Rotator = FRotator{0.f, RandomStream.FRandRange(0.f, 360.f), 0.f};
+
+
+	if (ChildrenNodes.Num() == 4)
+	{
+		Child = ChildrenNodes.Pop();
+		Position = FVector{1.f, 0.f, 1.f};
+		Position = Rotator.RotateVector(Position);
+		Position = ParentRotation.RotateVector(Position);
+		Graph.SetOffset(Child, Position);
+		Graph.RecalculateDirection(Child);
+
+		Child = ChildrenNodes.Pop();
+		Position = FVector{-1.f, 0.f, 1.f};
+		Position = Rotator.RotateVector(Position);
+		Position = ParentRotation.RotateVector(Position);
+		Graph.SetOffset(Child, Position);
+		Graph.RecalculateDirection(Child);
+	}
+
+	Child = ChildrenNodes.Pop();
+	Position = FVector{0.f, 1.f, 1.f};
+	Position = Rotator.RotateVector(Position);
+	Position = ParentRotation.RotateVector(Position);
+	Graph.SetOffset(Child, Position);
+	Graph.RecalculateDirection(Child);
+
+	Child = ChildrenNodes.Pop();
+	Position = FVector{0.f, -1.f, 1.f};
+	Position = Rotator.RotateVector(Position);
+	Position = ParentRotation.RotateVector(Position);
+	Graph.SetOffset(Child, Position);
+	Graph.RecalculateDirection(Child);
+}
+
+void FGrowthModel::GrowBranches(FBranchGraph& Graph, const float Phi, const float Beta, const float LMax,
+                                const float G1, const float Alpha, const FVector& GDir, const float TropismStrength)
+{
+	TArray<int32> Branches(Graph.AvailableBranches);
+	Algo::Reverse(Branches);
+
+	TArray<int32> ChildrenBranches;
+
+	for (const int32 Branch : Branches)
+	{
+		// Connecting segments lead into the graph of the child module
+		int32 Node;
+		FBranchGraph* NodeGraph = Graph.GetDestination(Branch, Node);
+
+		// In the paper, the age of a branch is defined by = module age - oldest node in the segment age
+		// which doesn't make sense as the beginning branch ages will always be zero, and all other branches will
+		// never age as the difference between the max age and Au will always be the same...
+		// Therefore, after talking with Jian, I think the branch age should be the age of the destination node as
+		// that's when the branch was added
+		const float BranchAge = NodeGraph->Ages[Node];
+
+		// ========== Equation 8 ==========
+		NodeGraph->GetAvailableChildrenBranches(Node, ChildrenBranches);
+
+		if (ChildrenBranches.Num() != 0)
+		{
+			// If the branch has children, set the diameter to sqrt(sum of (children diameter^2) of all children)
+			float SummedChildDiameters = 0.f;
+
+			for (const int32 ChildrenBranch : ChildrenBranches)
+			{
+				SummedChildDiameters += FMath::Square(NodeGraph->Diameters[ChildrenBranch]);
+			}
+
+			Graph.Diameters[Branch] = FMath::Sqrt(SummedChildDiameters);
+		}
+		else
+		{
+			// If the branch has no children the diameter is the thickening factor
+			Graph.Diameters[Branch] = Phi;
+		}
+
+		// ========== Equation 9 ==========
+		const float NewBranchLength = FMath::Min(LMax, Beta * BranchAge);
+		const float BranchChange = NewBranchLength - NodeGraph->GetParentBranchLength(Node);
+		FVector Growth = BranchChange * NodeGraph->Directions[Node];
+
+		NodeGraph->Translate(Node, Growth);
+
+		// Section 5.3.1 - Module Adaptation
+		// This is where the tropism is used to effect positions of the nodes
+		const float G2 = Alpha * -1.f * TropismStrength;
+		FVector TropismOffset;
+		const float Denominator = BranchAge + G1;
+
+		if (Denominator == 0.f)
+		{
+			TropismOffset = FVector::ZeroVector;
+		}
+		else
+		{
+			TropismOffset = (G1 * GDir * G2) / Denominator;
+		}
+
+		if ((NodeGraph->Positions[Node] + TropismOffset).Z < 0.f)
+		{
+			TropismOffset.Z = 0.1f - NodeGraph->Positions[Node].Z;
+		}
+
+		if (BranchAge < 2.f)
+		{
+			TropismOffset = FVector::ZeroVector;
+		}
+
+		NodeGraph->Translate(Node, TropismOffset);
+		NodeGraph->RecalculateDirection(Node);
+	}
+}
+
+float FGrowthModel::GetLightExposure(const float Collisions)
+{
+	return FMath::Clamp(FMath::Exp(-Collisions), 0.f, 1.f);
+}
+
+float FGrowthModel::CalculateIntersectingVolume(const FSphere& Sphere, const FSphere& Neighbor)
+{
+	// See https://mathworld.wolfram.com/Sphere-SphereIntersection.html
+	const float d = FVector::Distance(Sphere.Center, Neighbor.Center);
+	const float R = Sphere.W;
+	const float r = Neighbor.W;
+
+	// Ensure the spheres are intersecting
+	ensure(d < R + r);
+
+	// PI * (R + r - d)^2 * (d^2 + 2dr - 3r^2 + 2dR + 6rR - 3R^2) / 12d
+	return (PI *
+			FMath::Square(R + r - d) *
+			(FMath::Square(d) + 2.f * d * r - 3 * FMath::Square(r) + 2.f * d * R + 6.f * r * R - 3.f *
+				FMath::Square(R))) /
+		(12.f * d);
+}
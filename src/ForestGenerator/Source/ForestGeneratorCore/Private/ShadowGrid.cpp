@@ -0,0 +1,176 @@
+// Ollie Nicholls, 2021
+
+
+#include "ShadowGrid.h"
+
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	/**
+	 * @brief How the shadow of a voxel is spread over the 3x3 voxels below it, this sums to 1 so only the falloff
+	 * reduces the shadow.
+	 */
+	constexpr float SpreadWeights[3][3] = {
+		{1.f / 16.f, 2.f / 16.f, 1.f / 16.f},
+		{2.f / 16.f, 4.f / 16.f, 2.f / 16.f},
+		{1.f / 16.f, 2.f / 16.f, 1.f / 16.f}
+	};
+}
+
+void FShadowGrid::Build(const TArray<FSphere>& Spheres, const float InVoxelSize, const float Falloff,
+                        const bool bForceSingleThread)
+{
+	Occupancy.Reset();
+	Shadow.Reset();
+	SizeX = SizeY = SizeZ = 0;
+
+	if (Spheres.Num() == 0)
+	{
+		return;
+	}
+
+	FBox Bounds{ForceInit};
+
+	for (const FSphere& Sphere : Spheres)
+	{
+		Bounds += FBox::BuildAABB(Sphere.Center, FVector{Sphere.W});
+	}
+
+	// Leave a voxel of padding around the edges so the shadow can spread out past the outermost spheres
+	const FVector Extent = Bounds.GetSize();
+	VoxelSize = FMath::Max3(InVoxelSize, Extent.GetMax() / static_cast<float>(MaxVoxelsPerAxis - 2),
+	                        KINDA_SMALL_NUMBER);
+	Origin = Bounds.Min - FVector{VoxelSize};
+
+	SizeX = FMath::Min(FMath::CeilToInt(Extent.X / VoxelSize) + 2, MaxVoxelsPerAxis);
+	SizeY = FMath::Min(FMath::CeilToInt(Extent.Y / VoxelSize) + 2, MaxVoxelsPerAxis);
+	SizeZ = FMath::Min(FMath::CeilToInt(Extent.Z / VoxelSize) + 2, MaxVoxelsPerAxis);
+
+	Occupancy.SetNumZeroed(SizeX * SizeY * SizeZ);
+	Shadow.SetNumZeroed(SizeX * SizeY * SizeZ);
+
+	for (const FSphere& Sphere : Spheres)
+	{
+		Stamp(Sphere);
+	}
+
+	// Light comes from straight above, so the top layer is never shadowed and each layer below only depends on the
+	// layer directly above it
+	for (int32 Z = SizeZ - 2; Z >= 0; Z--)
+	{
+		ParallelFor(SizeY, [this, Z, Falloff](const int32 Y)
+		{
+			for (int32 X = 0; X < SizeX; X++)
+			{
+				float VoxelShadow = 0.f;
+
+				for (int32 DY = -1; DY <= 1; DY++)
+				{
+					const int32 AboveY = Y + DY;
+
+					if (AboveY < 0 || AboveY >= SizeY)
+					{
+						continue;
+					}
+
+					for (int32 DX = -1; DX <= 1; DX++)
+					{
+						const int32 AboveX = X + DX;
+
+						if (AboveX < 0 || AboveX >= SizeX)
+						{
+							continue;
+						}
+
+						const int32 AboveIndex = GetVoxelIndex(AboveX, AboveY, Z + 1);
+						VoxelShadow += SpreadWeights[DY + 1][DX + 1] * (Shadow[AboveIndex] + Occupancy[AboveIndex]);
+					}
+				}
+
+				Shadow[GetVoxelIndex(X, Y, Z)] = Falloff * VoxelShadow;
+			}
+		}, bForceSingleThread);
+	}
+}
+
+float FShadowGrid::GetShadow(const FVector& Position) const
+{
+	if (Shadow.Num() == 0)
+	{
+		return 0.f;
+	}
+
+	return Shadow[GetVoxelIndex(GetVoxelCoordinate(Position.X, Origin.X, SizeX),
+	                            GetVoxelCoordinate(Position.Y, Origin.Y, SizeY),
+	                            GetVoxelCoordinate(Position.Z, Origin.Z, SizeZ))];
+}
+
+void FShadowGrid::Stamp(const FSphere& Sphere)
+{
+	const int32 MinX = GetVoxelCoordinate(Sphere.Center.X - Sphere.W, Origin.X, SizeX);
+	const int32 MinY = GetVoxelCoordinate(Sphere.Center.Y - Sphere.W, Origin.Y, SizeY);
+	const int32 MinZ = GetVoxelCoordinate(Sphere.Center.Z - Sphere.W, Origin.Z, SizeZ);
+	const int32 MaxX = GetVoxelCoordinate(Sphere.Center.X + Sphere.W, Origin.X, SizeX);
+	const int32 MaxY = GetVoxelCoordinate(Sphere.Center.Y + Sphere.W, Origin.Y, SizeY);
+	const int32 MaxZ = GetVoxelCoordinate(Sphere.Center.Z + Sphere.W, Origin.Z, SizeZ);
+
+	const float RadiusSquared = FMath::Square(Sphere.W);
+
+	const auto IsInside = [&](const int32 X, const int32 Y, const int32 Z)
+	{
+		const FVector VoxelCenter = Origin + FVector{X + 0.5f, Y + 0.5f, Z + 0.5f} * VoxelSize;
+		return FVector::DistSquared(VoxelCenter, Sphere.Center) <= RadiusSquared;
+	};
+
+	int32 NumCovered = 0;
+
+	for (int32 Z = MinZ; Z <= MaxZ; Z++)
+	{
+		for (int32 Y = MinY; Y <= MaxY; Y++)
+		{
+			for (int32 X = MinX; X <= MaxX; X++)
+			{
+				NumCovered += IsInside(X, Y, Z) ? 1 : 0;
+			}
+		}
+	}
+
+	const float VoxelVolume = FMath::Cube(VoxelSize);
+
+	if (NumCovered == 0)
+	{
+		// Smaller than a voxel so all of it goes into the voxel containing the center
+		Occupancy[GetVoxelIndex(GetVoxelCoordinate(Sphere.Center.X, Origin.X, SizeX),
+		                        GetVoxelCoordinate(Sphere.Center.Y, Origin.Y, SizeY),
+		                        GetVoxelCoordinate(Sphere.Center.Z, Origin.Z, SizeZ))] += Sphere.GetVolume() /
+			VoxelVolume;
+		return;
+	}
+
+	const float VoxelOccupancy = Sphere.GetVolume() / (VoxelVolume * static_cast<float>(NumCovered));
+
+	for (int32 Z = MinZ; Z <= MaxZ; Z++)
+	{
+		for (int32 Y = MinY; Y <= MaxY; Y++)
+		{
+			for (int32 X = MinX; X <= MaxX; X++)
+			{
+				if (IsInside(X, Y, Z))
+				{
+					Occupancy[GetVoxelIndex(X, Y, Z)] += VoxelOccupancy;
+				}
+			}
+		}
+	}
+}
+
+int32 FShadowGrid::GetVoxelCoordinate(const float Value, const float OriginValue, const int32 Size) const
+{
+	return FMath::Clamp(FMath::FloorToInt((Value - OriginValue) / VoxelSize), 0, Size - 1);
+}
+
+int32 FShadowGrid::GetVoxelIndex(const int32 X, const int32 Y, const int32 Z) const
+{
+	return (Z * SizeY + Y) * SizeX + X;
+}
@@ -0,0 +1,144 @@
+// Ollie Nicholls, 2021
+
+
+#include "SphereBatch.h"
+
+
+void FSphereBatch::Reset(const int32 NewSize)
+{
+	CenterX.Reset(NewSize);
+	CenterY.Reset(NewSize);
+	CenterZ.Reset(NewSize);
+	Radius.Reset(NewSize);
+}
+
+void FSphereBatch::Add(const FSphere& Sphere)
+{
+	CenterX.Add(Sphere.Center.X);
+	CenterY.Add(Sphere.Center.Y);
+	CenterZ.Add(Sphere.Center.Z);
+	Radius.Add(Sphere.W);
+}
+
+int32 FSphereBatch::Num() const
+{
+	return Radius.Num();
+}
+
+FSphere FSphereBatch::Get(const int32 Index) const
+{
+	return FSphere{FVector{CenterX[Index], CenterY[Index], CenterZ[Index]}, Radius[Index]};
+}
+
+float FSphereBatch::SumIntersectingVolumes(const FSphere& Sphere) const
+{
+	// See FGrowthModel::CalculateIntersectingVolume for the scalar version of this, for each neighbor:
+	// PI * (R + r - d)^2 * (d^2 + 2dr - 3r^2 + 2dR + 6rR - 3R^2) / 12d
+	// or if that is negative the neighbor is fully inside the sphere so its whole volume is used instead
+
+	const VectorRegister SphereX = VectorSetFloat1(Sphere.Center.X);
+	const VectorRegister SphereY = VectorSetFloat1(Sphere.Center.Y);
+	const VectorRegister SphereZ = VectorSetFloat1(Sphere.Center.Z);
+	const VectorRegister R = VectorSetFloat1(Sphere.W);
+	const VectorRegister RSquared = VectorMultiply(R, R);
+
+	const VectorRegister Zero = VectorZero();
+	const VectorRegister Two = VectorSetFloat1(2.f);
+	const VectorRegister Three = VectorSetFloat1(3.f);
+	const VectorRegister Six = VectorSetFloat1(6.f);
+	const VectorRegister PiOverTwelve = VectorSetFloat1(PI / 12.f);
+	const VectorRegister FourThirdsPi = VectorSetFloat1(4.f / 3.f * PI);
+
+	// Concentric spheres would divide by zero, so they are treated as fully inside instead
+	const VectorRegister MinDistanceSquared = VectorSetFloat1(SMALL_NUMBER);
+
+	const VectorRegister LaneIndices = MakeVectorRegister(0.f, 1.f, 2.f, 3.f);
+
+	VectorRegister Sum = Zero;
+
+	const int32 NumSpheres = Num();
+
+	for (int32 i = 0; i < NumSpheres; i += 4)
+	{
+		const int32 NumLanes = FMath::Min(NumSpheres - i, 4);
+
+		VectorRegister X;
+		VectorRegister Y;
+		VectorRegister Z;
+		VectorRegister r;
+
+		if (NumLanes == 4)
+		{
+			X = VectorLoad(&CenterX[i]);
+			Y = VectorLoad(&CenterY[i]);
+			Z = VectorLoad(&CenterZ[i]);
+			r = VectorLoad(&Radius[i]);
+		}
+		else
+		{
+			// Copy the last few spheres into a full register, the unused lanes are masked out below
+			float TailX[4] = {0.f, 0.f, 0.f, 0.f};
+			float TailY[4] = {0.f, 0.f, 0.f, 0.f};
+			float TailZ[4] = {0.f, 0.f, 0.f, 0.f};
+			float TailRadius[4] = {0.f, 0.f, 0.f, 0.f};
+
+			for (int32 Lane = 0; Lane < NumLanes; Lane++)
+			{
+				TailX[Lane] = CenterX[i + Lane];
+				TailY[Lane] = CenterY[i + Lane];
+				TailZ[Lane] = CenterZ[i + Lane];
+				TailRadius[Lane] = Radius[i + Lane];
+			}
+
+			X = VectorLoad(TailX);
+			Y = VectorLoad(TailY);
+			Z = VectorLoad(TailZ);
+			r = VectorLoad(TailRadius);
+		}
+
+		const VectorRegister DeltaX = VectorSubtract(X, SphereX);
+		const VectorRegister DeltaY = VectorSubtract(Y, SphereY);
+		const VectorRegister DeltaZ = VectorSubtract(Z, SphereZ);
+
+		VectorRegister DistanceSquared = VectorMultiply(DeltaX, DeltaX);
+		DistanceSquared = VectorMultiplyAdd(DeltaY, DeltaY, DistanceSquared);
+		DistanceSquared = VectorMultiplyAdd(DeltaZ, DeltaZ, DistanceSquared);
+		const VectorRegister Concentric = VectorCompareGT(MinDistanceSquared, DistanceSquared);
+		DistanceSquared = VectorMax(DistanceSquared, MinDistanceSquared);
+
+		const VectorRegister InverseDistance = VectorReciprocalSqrtAccurate(DistanceSquared);
+		const VectorRegister d = VectorMultiply(DistanceSquared, InverseDistance);
+
+		// (R + r - d)^2
+		const VectorRegister Overlap = VectorSubtract(VectorAdd(R, r), d);
+		const VectorRegister OverlapSquared = VectorMultiply(Overlap, Overlap);
+
+		// d^2 + 2dr - 3r^2 + 2dR + 6rR - 3R^2
+		const VectorRegister rSquared = VectorMultiply(r, r);
+		VectorRegister Polynomial = DistanceSquared;
+		Polynomial = VectorMultiplyAdd(VectorMultiply(Two, d), r, Polynomial);
+		Polynomial = VectorSubtract(Polynomial, VectorMultiply(Three, rSquared));
+		Polynomial = VectorMultiplyAdd(VectorMultiply(Two, d), R, Polynomial);
+		Polynomial = VectorMultiplyAdd(VectorMultiply(Six, r), R, Polynomial);
+		Polynomial = VectorSubtract(Polynomial, VectorMultiply(Three, RSquared));
+
+		VectorRegister Volume = VectorMultiply(VectorMultiply(PiOverTwelve, OverlapSquared),
+		                                       VectorMultiply(Polynomial, InverseDistance));
+
+		// Neighbor fully inside the sphere
+		const VectorRegister NeighborVolume = VectorMultiply(FourThirdsPi, VectorMultiply(rSquared, r));
+		const VectorRegister FullyInside = VectorBitwiseOr(VectorCompareGT(Zero, Volume), Concentric);
+		Volume = VectorSelect(FullyInside, NeighborVolume, Volume);
+
+		// Mask out the unused lanes of the last register
+		const VectorRegister LaneMask = VectorCompareGT(VectorSetFloat1(static_cast<float>(NumLanes)), LaneIndices);
+		Volume = VectorSelect(LaneMask, Volume, Zero);
+
+		Sum = VectorAdd(Sum, Volume);
+	}
+
+	float Lanes[4];
+	VectorStore(Sum, Lanes);
+
+	return Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+}
@@ -0,0 +1,314 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "BranchSegment.h"
+
+/**
+ * @brief The type of a node.
+ */
+enum class ENodeType : uint8
+{
+	Root,
+	Normal,
+	Connecting,
+	Terminal
+};
+
+/**
+ * @brief The graph of a branch module as described in section 5.1.
+ * Nodes and branch segments are stored as structures of arrays and referred to by their index, so all the data used
+ * during a simulation step is contiguous and none of it needs tracking by the garbage collector.
+ * Node 0 is always the root. The first NumBranches segments are the ones from the graph definition, these are followed
+ * by one connecting segment per node which is used when a child module is attached to that node.
+ * A connecting node links to the graph of its child module, and the root of a child module links back to the
+ * connecting node, so the recursive operations here carry on into child modules the same as the paper's single graph.
+ * Node positions are stored as offsets from their parent so moving a node moves everything attached to it for free,
+ * the world positions are only worked out when they are needed by resolving the offsets from the root down.
+ */
+struct FORESTGENERATORCORE_API FBranchGraph
+{
+	static constexpr int32 RootNode = 0;
+
+	/**
+	 * @brief The maximum number of children a node can have.
+	 */
+	static constexpr int32 MaxChildren = 5;
+
+	// ========== Nodes ==========
+
+	/**
+	 * @brief The offset of each node from its parent, or the world position for the root of a plant.
+	 */
+	TArray<FVector> Offsets;
+
+	/**
+	 * @brief The world position of each node as of the last time it was resolved or moved.
+	 * Moving a node does not update the positions of the nodes attached to it until they are resolved again.
+	 */
+	TArray<FVector> Positions;
+
+	/**
+	 * @brief Unit vector direction from the parent of each node.
+	 */
+	TArray<FVector> Directions;
+
+	TArray<float> Ages;
+
+	TArray<float> Vigors;
+
+	TArray<float> LightExposures;
+
+	TArray<ENodeType> Types;
+
+	/**
+	 * @brief The segment connecting each node to its parent, INDEX_NONE for the root.
+	 */
+	TArray<int32> ParentBranches;
+
+	/**
+	 * @brief Offsets into ChildBranches, the children of node N are from FirstChildBranch[N] to FirstChildBranch[N + 1].
+	 */
+	TArray<int32> FirstChildBranch;
+
+	/**
+	 * @brief The child segments of every node in node order.
+	 */
+	TArray<int32> ChildBranches;
+
+	/**
+	 * @brief The child of each node with the lowest index, which gets the main share of the vigor in Eq 2, INDEX_NONE
+	 * for nodes without children. Worked out from ChildBranches so it is never saved.
+	 */
+	TArray<int32> MainChildren;
+
+	/**
+	 * @brief The graph of the child module attached to each connecting node, nullptr for all other nodes.
+	 */
+	TArray<FBranchGraph*> ChildGraphs;
+
+	// ========== Branch segments ==========
+
+	TArray<int32> Sources;
+
+	/**
+	 * @brief The destination node of each segment, INDEX_NONE for connecting segments as that is the root of the
+	 * child graph.
+	 */
+	TArray<int32> Destinations;
+
+	TArray<float> Diameters;
+
+	TArray<bool> Available;
+
+	/**
+	 * @brief The depth of the source node of each segment from the root.
+	 */
+	TArray<int32> Depths;
+
+	/**
+	 * @brief The available segments in the order they were made available, including connecting segments.
+	 */
+	TArray<int32> AvailableBranches;
+
+	/**
+	 * @brief How many segments came from the graph definition.
+	 */
+	int32 NumBranches = 0;
+
+	/**
+	 * @brief The child segments of every node ordered by depth, then by index. The segments at depth D are from
+	 * FirstDepthBranch[D] to FirstDepthBranch[D + 1]. Worked out from ChildBranches so it is never saved.
+	 */
+	TArray<int32> DepthBranches;
+
+	/**
+	 * @brief Offsets into DepthBranches for each depth, with one more entry than there are depths.
+	 */
+	TArray<int32> FirstDepthBranch;
+
+	/**
+	 * @brief The shallowest depth that still has segments to make available, every segment above it already is.
+	 */
+	int32 NextDepth = 0;
+
+	/**
+	 * @brief The available nodes in topological order with children before their parents, this is only sorted again
+	 * after segments are made available.
+	 */
+	TArray<int32> SortedNodes;
+
+	/**
+	 * @brief Set when segments are made available and SortedNodes needs sorting again.
+	 */
+	bool bSortedNodesDirty = true;
+
+	/**
+	 * @brief The graph of the parent module, nullptr if this is the root module of a plant.
+	 */
+	FBranchGraph* ParentGraph = nullptr;
+
+	/**
+	 * @brief The connecting node in the parent graph this graph is attached to.
+	 */
+	int32 ParentNode = INDEX_NONE;
+
+	/**
+	 * @brief Allocates the nodes and segments with their default values.
+	 * @param NumNodes How many nodes the graph has
+	 * @param InNumBranches How many segments the graph definition has
+	 */
+	void Reset(const int32 NumNodes, const int32 InNumBranches);
+
+	int32 GetNumNodes() const;
+
+	/**
+	 * @brief Make a segment from the graph definition available, adding its destination node to the graph.
+	 */
+	void MakeAvailable(const int32 Branch);
+
+	/**
+	 * @brief Get the connecting segment used when a child module is attached to a node.
+	 */
+	int32 GetConnectionBranch(const int32 Node) const;
+
+	/**
+	 * @brief Get the graph and node a segment leads to, this is the root of the child graph for connecting segments.
+	 */
+	FBranchGraph* GetDestination(const int32 Branch, int32& OutNode);
+
+	/**
+	 * @brief Attach a child graph to a terminal node, making it a connecting node.
+	 * The child graph's root is made relative to the node, so it should be at the node's position.
+	 * @return If the child graph was attached
+	 */
+	bool ConnectChildGraph(const int32 Node, FBranchGraph* ChildGraph);
+
+	/**
+	 * @brief Detach the child graph from a connecting node, making it a terminal node again.
+	 */
+	void DisconnectChildGraph(const int32 Node);
+
+	/**
+	 * @brief Translate a node and all its children, including any child graphs.
+	 * Only the position of the node itself is updated straight away.
+	 */
+	void Translate(const int32 Node, const FVector& Translation);
+
+	/**
+	 * @brief Place a node at an offset from its parent.
+	 */
+	void SetOffset(const int32 Node, const FVector& Offset);
+
+	/**
+	 * @brief Update the world positions of the available nodes from their offsets, starting from the root.
+	 * The root of a child graph is placed relative to the last resolved position of its connecting node.
+	 * @param bIncludeChildGraphs If the positions in attached child graphs should be resolved as well
+	 */
+	void ResolvePositions(const bool bIncludeChildGraphs);
+
+	/**
+	 * @brief Get the world position of a node from the offsets of it and all its parents.
+	 */
+	FVector GetWorldPosition(const int32 Node) const;
+
+	/**
+	 * @brief Increase the age of a node and all its available children.
+	 */
+	void IncreaseAge(const int32 Node, const float DeltaAge);
+
+	/**
+	 * @brief Recalculate the direction of a node from its offset.
+	 */
+	void RecalculateDirection(const int32 Node);
+
+	/**
+	 * @brief Rotates the direction of a node.
+	 */
+	void SetDirection(const int32 Node, const FRotator& Rotator);
+
+	bool HasParent(const int32 Node) const;
+
+	bool IsParentBranchAvailable(const int32 Node) const;
+
+	float GetParentBranchDiameter(const int32 Node) const;
+
+	/**
+	 * @brief Get the last resolved world position of a node's parent.
+	 */
+	FVector GetParentPosition(const int32 Node) const;
+
+	/**
+	 * @brief Get the length of the segment from the parent to a node.
+	 */
+	float GetParentBranchLength(const int32 Node) const;
+
+	/**
+	 * @brief Get the available child segments of a node, for a connecting node this is its connecting segment.
+	 */
+	void GetAvailableChildrenBranches(const int32 Node, TArray<int32>& OutBranches) const;
+
+	/**
+	 * @brief Get the nodes of all the children of a node, available or not, in this graph.
+	 * Connecting nodes have no children in this graph.
+	 */
+	void GetChildren(const int32 Node, TArray<int32>& OutChildren) const;
+
+	/**
+	 * @brief Works out MainChildren from the child segments of every node.
+	 */
+	void CalculateMainChildren();
+
+	/**
+	 * @brief Works out DepthBranches and FirstDepthBranch from the child segments of every node, and NextDepth from
+	 * the segments already available.
+	 */
+	void CalculateDepthOrder();
+
+	/**
+	 * @brief Sorts the available nodes into a topological order with children before their parents.
+	 * Child graphs are not included.
+	 */
+	void TopologicalSort(TArray<int32>& OutSortedNodes) const;
+
+	/**
+	 * @brief Get the available nodes in topological order, only sorting them if segments have been made available
+	 * since the last call.
+	 */
+	const TArray<int32>& GetSortedNodes();
+
+	/**
+	 * @brief Get all the segments from a node and all attached available children, including child graphs.
+	 * The world positions are resolved as the branches are collected so they are always up to date.
+	 */
+	void GetBranchTransforms(const int32 Node, TArray<FBranchSegment>& OutBranches) const;
+
+	bool IsRoot(const int32 Node) const;
+
+	bool IsTerminal(const int32 Node) const;
+
+	bool IsConnecting(const int32 Node) const;
+
+	/**
+	 * @brief Saves or loads the nodes and segments of a graph.
+	 * The links to the parent and child graphs are not saved, they have to be connected again by the owning modules
+	 * after loading.
+	 */
+	friend FArchive& operator<<(FArchive& Ar, FBranchGraph& Graph);
+
+private:
+	enum class ENodeSortMark : uint8
+	{
+		None,
+		Temporary,
+		Permanent
+	};
+
+	void Visit(const int32 Node, TArray<ENodeSortMark>& SortMarks, TArray<int32>& OutSortedNodes) const;
+
+	void ResolveChildPositions(const int32 Node, const bool bIncludeChildGraphs);
+
+	void AppendBranchTransforms(const int32 Node, const FVector& Position, TArray<FBranchSegment>& OutBranches) const;
+};
@@ -0,0 +1,32 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "BranchGraph.h"
+
+/**
+ * @brief A graph definition compiled into the graph every branch module spawned from it starts with.
+ * Compiling validates the definition and works out the children and depths of the nodes, so this is done once per
+ * prototype by the module manager and spawning a module only has to copy the graph.
+ */
+struct FORESTGENERATORCORE_API FBranchModuleTemplate
+{
+	/**
+	 * @brief The graph of a newly spawned module before it is moved into place, with no segments available.
+	 */
+	FBranchGraph Graph;
+
+	/**
+	 * @brief The age at which a module spawned from this template can attach child modules.
+	 */
+	float AgeMature = 0.f;
+
+	/**
+	 * @brief Builds the template from the edges of a graph definition.
+	 * @param Edges The source and destination ID of each edge
+	 * @return If the definition was valid
+	 */
+	bool Compile(const TArray<TPair<int32, int32>>& Edges);
+};
@@ -0,0 +1,26 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A segment of a branch in world space, as collected from a graph for rendering.
+ */
+struct FBranchSegment
+{
+	FVector Start = FVector::ZeroVector;
+
+	FVector End = FVector::UpVector;
+
+	float Diameter = 1.f;
+
+	FBranchSegment() = default;
+
+	FBranchSegment(const FVector& Start, const FVector& End, const float Diameter)
+		: Start(Start),
+		  End(End),
+		  Diameter(Diameter)
+	{
+	}
+};
@@ -0,0 +1,477 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A dynamic bounding volume hierarchy of axis aligned boxes, based on the dynamic tree from Box2D.
+ * Each element is stored with a fattened box so small movements don't need the tree to change, elements are only
+ * reinserted once their tight box leaves the fattened one. The tree is kept balanced with rotations on insertion and
+ * removal so queries stay logarithmic without ever rebuilding.
+ * @tparam ElementType The type stored in each leaf
+ */
+template <typename ElementType>
+class TDynamicBoundsTree
+{
+public:
+	/**
+	 * @brief Adds a new element to the tree.
+	 * @param TightBounds The actual bounds of the element
+	 * @param Margin How much to fatten the bounds by
+	 * @param Element The element to store
+	 * @return The ID of the proxy that represents this element, used when moving or destroying it
+	 */
+	int32 CreateProxy(const FBox& TightBounds, const float Margin, const ElementType& Element)
+	{
+		const int32 ProxyID = AllocateNode();
+
+		Nodes[ProxyID].Bounds = TightBounds.ExpandBy(Margin);
+		Nodes[ProxyID].Element = Element;
+		Nodes[ProxyID].Height = 0;
+
+		InsertLeaf(ProxyID);
+
+		return ProxyID;
+	}
+
+	/**
+	 * @brief Removes an element from the tree.
+	 * @param ProxyID The ID returned by CreateProxy
+	 */
+	void DestroyProxy(const int32 ProxyID)
+	{
+		check(Nodes.IsValidIndex(ProxyID) && Nodes[ProxyID].IsLeaf());
+
+		RemoveLeaf(ProxyID);
+		FreeNode(ProxyID);
+	}
+
+	/**
+	 * @brief Updates the bounds of an element. The tree is only changed if the new bounds leave the fattened bounds.
+	 * @param ProxyID The ID returned by CreateProxy
+	 * @param TightBounds The actual bounds of the element
+	 * @param Margin How much to fatten the bounds by if the element has to be reinserted
+	 * @return If the element was reinserted
+	 */
+	bool MoveProxy(const int32 ProxyID, const FBox& TightBounds, const float Margin)
+	{
+		check(Nodes.IsValidIndex(ProxyID) && Nodes[ProxyID].IsLeaf());
+
+		if (Contains(Nodes[ProxyID].Bounds, TightBounds))
+		{
+			return false;
+		}
+
+		RemoveLeaf(ProxyID);
+		Nodes[ProxyID].Bounds = TightBounds.ExpandBy(Margin);
+		InsertLeaf(ProxyID);
+
+		return true;
+	}
+
+	/**
+	 * @brief Calls the visitor on every element whose fattened bounds overlap the query box.
+	 * @param QueryBounds The box to test against
+	 * @param Visitor Called with each overlapping element
+	 */
+	template <typename VisitorType>
+	void Query(const FBox& QueryBounds, VisitorType&& Visitor) const
+	{
+		if (Root == INDEX_NONE)
+		{
+			return;
+		}
+
+		TArray<int32, TInlineAllocator<64>> Stack;
+		Stack.Add(Root);
+
+		while (Stack.Num() > 0)
+		{
+			const FNode& Node = Nodes[Stack.Pop(false)];
+
+			if (!Node.Bounds.Intersect(QueryBounds))
+			{
+				continue;
+			}
+
+			if (Node.IsLeaf())
+			{
+				Visitor(Node.Element);
+			}
+			else
+			{
+				Stack.Add(Node.Child1);
+				Stack.Add(Node.Child2);
+			}
+		}
+	}
+
+	/**
+	 * @brief Get the element stored in a proxy.
+	 */
+	const ElementType& GetElement(const int32 ProxyID) const
+	{
+		return Nodes[ProxyID].Element;
+	}
+
+	/**
+	 * @brief Get the fattened bounds of a proxy.
+	 */
+	const FBox& GetFatBounds(const int32 ProxyID) const
+	{
+		return Nodes[ProxyID].Bounds;
+	}
+
+	/**
+	 * @brief Get the height of the tree, a leaf on its own has a height of 0.
+	 */
+	int32 GetHeight() const
+	{
+		return Root == INDEX_NONE ? 0 : Nodes[Root].Height;
+	}
+
+	/**
+	 * @brief Allocates space for a number of elements so the tree doesn't need to grow while they are added.
+	 */
+	void Reserve(const int32 NumElements)
+	{
+		// Every element but the first needs a leaf and an internal node
+		Nodes.Reserve(FMath::Max(2 * NumElements - 1, 0));
+	}
+
+	/**
+	 * @brief Removes every element from the tree.
+	 */
+	void Reset()
+	{
+		Nodes.Reset();
+		Root = INDEX_NONE;
+		FreeList = INDEX_NONE;
+	}
+
+private:
+	struct FNode
+	{
+		FBox Bounds{ForceInit};
+
+		ElementType Element{};
+
+		/**
+		 * @brief The parent node, or the next free node when this node is in the free list.
+		 */
+		int32 Parent = INDEX_NONE;
+
+		int32 Child1 = INDEX_NONE;
+
+		int32 Child2 = INDEX_NONE;
+
+		/**
+		 * @brief Leaves are 0, free nodes are -1.
+		 */
+		int32 Height = -1;
+
+		bool IsLeaf() const
+		{
+			return Child1 == INDEX_NONE;
+		}
+	};
+
+	static bool Contains(const FBox& Outer, const FBox& Inner)
+	{
+		return Outer.Min.X <= Inner.Min.X && Outer.Min.Y <= Inner.Min.Y && Outer.Min.Z <= Inner.Min.Z &&
+			Inner.Max.X <= Outer.Max.X && Inner.Max.Y <= Outer.Max.Y && Inner.Max.Z <= Outer.Max.Z;
+	}
+
+	static float GetSurfaceArea(const FBox& Box)
+	{
+		const FVector Size = Box.GetSize();
+		return 2.f * (Size.X * Size.Y + Size.Y * Size.Z + Size.Z * Size.X);
+	}
+
+	int32 AllocateNode()
+	{
+		int32 NodeID;
+
+		if (FreeList == INDEX_NONE)
+		{
+			NodeID = Nodes.AddDefaulted();
+		}
+		else
+		{
+			NodeID = FreeList;
+			FreeList = Nodes[NodeID].Parent;
+		}
+
+		FNode& Node = Nodes[NodeID];
+		Node.Parent = INDEX_NONE;
+		Node.Child1 = INDEX_NONE;
+		Node.Child2 = INDEX_NONE;
+		Node.Height = 0;
+
+		return NodeID;
+	}
+
+	void FreeNode(const int32 NodeID)
+	{
+		Nodes[NodeID].Parent = FreeList;
+		Nodes[NodeID].Height = -1;
+		FreeList = NodeID;
+	}
+
+	void InsertLeaf(const int32 Leaf)
+	{
+		if (Root == INDEX_NONE)
+		{
+			Root = Leaf;
+			Nodes[Root].Parent = INDEX_NONE;
+			return;
+		}
+
+		// Find the best sibling for the leaf using the surface area heuristic
+		const FBox LeafBounds = Nodes[Leaf].Bounds;
+		int32 Index = Root;
+
+		while (!Nodes[Index].IsLeaf())
+		{
+			const FNode& Node = Nodes[Index];
+
+			const float Area = GetSurfaceArea(Node.Bounds);
+			const float CombinedArea = GetSurfaceArea(Node.Bounds + LeafBounds);
+
+			// Cost of creating a new parent for this node and the new leaf
+			const float Cost = 2.f * CombinedArea;
+
+			// Minimum cost of pushing the leaf further down the tree
+			const float InheritanceCost = 2.f * (CombinedArea - Area);
+
+			auto GetDescendCost = [&](const int32 Child)
+			{
+				const FNode& ChildNode = Nodes[Child];
+				const float NewArea = GetSurfaceArea(LeafBounds + ChildNode.Bounds);
+				return ChildNode.IsLeaf()
+					       ? NewArea + InheritanceCost
+					       : NewArea - GetSurfaceArea(ChildNode.Bounds) + InheritanceCost;
+			};
+
+			const float Cost1 = GetDescendCost(Node.Child1);
+			const float Cost2 = GetDescendCost(Node.Child2);
+
+			if (Cost < Cost1 && Cost < Cost2)
+			{
+				break;
+			}
+
+			Index = (Cost1 < Cost2) ? Node.Child1 : Node.Child2;
+		}
+
+		const int32 Sibling = Index;
+
+		// Create a new parent for the sibling and the leaf
+		const int32 OldParent = Nodes[Sibling].Parent;
+		const int32 NewParent = AllocateNode();
+		Nodes[NewParent].Parent = OldParent;
+		Nodes[NewParent].Bounds = LeafBounds + Nodes[Sibling].Bounds;
+		Nodes[NewParent].Height = Nodes[Sibling].Height + 1;
+		Nodes[NewParent].Child1 = Sibling;
+		Nodes[NewParent].Child2 = Leaf;
+		Nodes[Sibling].Parent = NewParent;
+		Nodes[Leaf].Parent = NewParent;
+
+		if (OldParent != INDEX_NONE)
+		{
+			ReplaceChild(OldParent, Sibling, NewParent);
+		}
+		else
+		{
+			Root = NewParent;
+		}
+
+		Refit(Nodes[Leaf].Parent);
+	}
+
+	void RemoveLeaf(const int32 Leaf)
+	{
+		if (Leaf == Root)
+		{
+			Root = INDEX_NONE;
+			return;
+		}
+
+		const int32 Parent = Nodes[Leaf].Parent;
+		const int32 GrandParent = Nodes[Parent].Parent;
+		const int32 Sibling = (Nodes[Parent].Child1 == Leaf) ? Nodes[Parent].Child2 : Nodes[Parent].Child1;
+
+		// The parent is no longer needed, the sibling takes its place
+		Nodes[Sibling].Parent = GrandParent;
+		FreeNode(Parent);
+
+		if (GrandParent != INDEX_NONE)
+		{
+			ReplaceChild(GrandParent, Parent, Sibling);
+			Refit(GrandParent);
+		}
+		else
+		{
+			Root = Sibling;
+		}
+	}
+
+	void ReplaceChild(const int32 Parent, const int32 OldChild, const int32 NewChild)
+	{
+		if (Nodes[Parent].Child1 == OldChild)
+		{
+			Nodes[Parent].Child1 = NewChild;
+		}
+		else
+		{
+			Nodes[Parent].Child2 = NewChild;
+		}
+	}
+
+	/**
+	 * @brief Walks from the given node to the root, balancing and recalculating the bounds and heights.
+	 */
+	void Refit(int32 Index)
+	{
+		while (Index != INDEX_NONE)
+		{
+			Index = Balance(Index);
+
+			FNode& Node = Nodes[Index];
+			const FNode& Child1 = Nodes[Node.Child1];
+			const FNode& Child2 = Nodes[Node.Child2];
+
+			Node.Height = 1 + FMath::Max(Child1.Height, Child2.Height);
+			Node.Bounds = Child1.Bounds + Child2.Bounds;
+
+			Index = Node.Parent;
+		}
+	}
+
+	/**
+	 * @brief Performs a left or right rotation if node A is imbalanced.
+	 * @return The index of the node that is now in the place of A
+	 */
+	int32 Balance(const int32 IndexA)
+	{
+		FNode& A = Nodes[IndexA];
+
+		if (A.IsLeaf() || A.Height < 2)
+		{
+			return IndexA;
+		}
+
+		const int32 IndexB = A.Child1;
+		const int32 IndexC = A.Child2;
+		FNode& B = Nodes[IndexB];
+		FNode& C = Nodes[IndexC];
+
+		const int32 HeightDifference = C.Height - B.Height;
+
+		// Rotate C up
+		if (HeightDifference > 1)
+		{
+			const int32 IndexF = C.Child1;
+			const int32 IndexG = C.Child2;
+			FNode& F = Nodes[IndexF];
+			FNode& G = Nodes[IndexG];
+
+			// Swap A and C
+			C.Child1 = IndexA;
+			C.Parent = A.Parent;
+			A.Parent = IndexC;
+
+			if (C.Parent != INDEX_NONE)
+			{
+				ReplaceChild(C.Parent, IndexA, IndexC);
+			}
+			else
+			{
+				Root = IndexC;
+			}
+
+			// Keep the taller of F and G under C
+			if (F.Height > G.Height)
+			{
+				C.Child2 = IndexF;
+				A.Child2 = IndexG;
+				G.Parent = IndexA;
+				A.Bounds = B.Bounds + G.Bounds;
+				C.Bounds = A.Bounds + F.Bounds;
+				A.Height = 1 + FMath::Max(B.Height, G.Height);
+				C.Height = 1 + FMath::Max(A.Height, F.Height);
+			}
+			else
+			{
+				C.Child2 = IndexG;
+				A.Child2 = IndexF;
+				F.Parent = IndexA;
+				A.Bounds = B.Bounds + F.Bounds;
+				C.Bounds = A.Bounds + G.Bounds;
+				A.Height = 1 + FMath::Max(B.Height, F.Height);
+				C.Height = 1 + FMath::Max(A.Height, G.Height);
+			}
+
+			return IndexC;
+		}
+
+		// Rotate B up
+		if (HeightDifference < -1)
+		{
+			const int32 IndexD = B.Child1;
+			const int32 IndexE = B.Child2;
+			FNode& D = Nodes[IndexD];
+			FNode& E = Nodes[IndexE];
+
+			// Swap A and B
+			B.Child1 = IndexA;
+			B.Parent = A.Parent;
+			A.Parent = IndexB;
+
+			if (B.Parent != INDEX_NONE)
+			{
+				ReplaceChild(B.Parent, IndexA, IndexB);
+			}
+			else
+			{
+				Root = IndexB;
+			}
+
+			// Keep the taller of D and E under B
+			if (D.Height > E.Height)
+			{
+				B.Child2 = IndexD;
+				A.Child1 = IndexE;
+				E.Parent = IndexA;
+				A.Bounds = C.Bounds + E.Bounds;
+				B.Bounds = A.Bounds + D.Bounds;
+				A.Height = 1 + FMath::Max(C.Height, E.Height);
+				B.Height = 1 + FMath::Max(A.Height, D.Height);
+			}
+			else
+			{
+				B.Child2 = IndexE;
+				A.Child1 = IndexD;
+				D.Parent = IndexA;
+				A.Bounds = C.Bounds + D.Bounds;
+				B.Bounds = A.Bounds + E.Bounds;
+				A.Height = 1 + FMath::Max(C.Height, D.Height);
+				B.Height = 1 + FMath::Max(A.Height, E.Height);
+			}
+
+			return IndexB;
+		}
+
+		return IndexA;
+	}
+
+	/**
+	 * @brief All the nodes, both internal and leaves. Freed nodes are kept in a linked list through their Parent.
+	 */
+	TArray<FNode> Nodes;
+
+	int32 Root = INDEX_NONE;
+
+	int32 FreeList = INDEX_NONE;
+};
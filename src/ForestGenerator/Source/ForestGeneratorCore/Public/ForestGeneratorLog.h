@@ -0,0 +1,7 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+FORESTGENERATORCORE_API DECLARE_LOG_CATEGORY_EXTERN(LogForestGenerator, Log, All);
@@ -0,0 +1,117 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FBranchGraph;
+
+/**
+ * @brief The growth model of a single branch module from section 5 of the paper.
+ * Everything here works on a module's graph and plain values only, so it can be used and tested without any UObjects.
+ */
+struct FORESTGENERATORCORE_API FGrowthModel
+{
+	/**
+	 * @brief Equation 2, the share of a node's vigor given to its main child, the rest goes to the lateral children.
+	 * @param Vigor The vigor of the node
+	 * @param MainLightExposure The light exposure of the main child
+	 * @param LateralLightExposure The light exposure of the lateral children
+	 * @param ApicalControl The ratio of limiting lateral buds leading to a plant developing a trunk
+	 * @return The vigor of the main child
+	 */
+	static float GetMainChildVigor(const float Vigor, const float MainLightExposure, const float LateralLightExposure,
+	                               const float ApicalControl);
+
+	/**
+	 * @brief Section 5.2, accumulates the light exposure of the nodes into the root in a basipetal pass, then
+	 * redistributes the root's vigor to the nodes using equation 2 in an acropetal pass.
+	 * The vigor reaching a connecting node is passed on to the root of its child graph.
+	 * @param Graph The graph, with the light exposure of its terminal nodes set
+	 * @param ApicalControl The ratio of limiting lateral buds leading to a plant developing a trunk
+	 */
+	static void CalculatePerNodeVigor(FBranchGraph& Graph, const float ApicalControl);
+
+	/**
+	 * @brief Equation 5, how quickly a module with the given vigor develops.
+	 * @param Vigor The vigor of the module, clamped to VMax
+	 * @param VMin Minimum vigor clamp
+	 * @param VMax Maximum vigor clamp
+	 * @param GP Growth potential
+	 * @return The growth rate
+	 */
+	static float GetGrowthRate(const float Vigor, const float VMin, const float VMax, const float GP);
+
+	/**
+	 * @brief Equation 6, the change in physiological age over a time step.
+	 * @param GrowthRate The growth rate from equation 5
+	 * @param DT The simulation time step
+	 * @return The change in physiological age
+	 */
+	static float GetDeltaAge(const float GrowthRate, const float DT);
+
+	/**
+	 * @brief Equations 5 and 6 for many modules at once, four at a time. Gives exactly the same results as clamping
+	 * each vigor to VMax and calling GetGrowthRate and GetDeltaAge.
+	 * @param Vigors The vigor of each module
+	 * @param OutDeltaAges The change in physiological age of each module, resized to match Vigors
+	 * @param VMin Minimum vigor clamp
+	 * @param VMax Maximum vigor clamp
+	 * @param GP Growth potential
+	 * @param DT The simulation time step
+	 */
+	static void CalculateDeltaAges(const TArray<float>& Vigors, TArray<float>& OutDeltaAges, const float VMin,
+	                               const float VMax, const float GP, const float DT);
+
+	/**
+	 * @brief Makes available every segment whose depth has been reached by the module's physiological age, ageing the
+	 * new nodes by how far past their depth the module is and placing the children of their parents.
+	 * Only the depths from the graph's NextDepth up to the age are looked at, so a step that reaches no new depth
+	 * costs nothing.
+	 * @param Graph The graph, NextDepth is moved past every depth reached
+	 * @param PhysiologicalAge The physiological age of the module
+	 * @param Straightness How straight the growth of the plant is
+	 * @param RandomStream The module's random stream
+	 */
+	static void GrowGraph(FBranchGraph& Graph, const float PhysiologicalAge, const float Straightness,
+	                      FRandomStream& RandomStream);
+
+	/**
+	 * @brief Places the children of a node around the direction of the node.
+	 * @param Graph The graph
+	 * @param Parent The node
+	 * @param Straightness How straight the growth of the plant is, 1 places an odd child straight on
+	 * @param RandomStream The module's random stream
+	 */
+	static void SpawnChildNodes(FBranchGraph& Graph, const int32 Parent, const float Straightness,
+	                            FRandomStream& RandomStream);
+
+	/**
+	 * @brief Equations 8 and 9 and section 5.3.1, sets the diameter of every available segment from its children,
+	 * lengthens it from its age and bends it by tropism. Segments are visited newest first so children are done before
+	 * their parents.
+	 * @param Graph The graph, its child graphs have to have grown already
+	 * @param Phi The default thickness of branches
+	 * @param Beta Branch length scaling coefficient
+	 * @param LMax Max branch length
+	 * @param G1 Control how fast the effect of tropism decreases with time
+	 * @param Alpha Control the angle of tropism, negative represents gravitropsim, positive phototropism
+	 * @param GDir Normalized direction of gravity
+	 * @param TropismStrength The overall strength of the tropism
+	 */
+	static void GrowBranches(FBranchGraph& Graph, const float Phi, const float Beta, const float LMax, const float G1,
+	                         const float Alpha, const FVector& GDir, const float TropismStrength);
+
+	/**
+	 * @brief The light exposure of a module from how much of it collides with its neighbors.
+	 * @param Collisions The collisions, or the shadow when using shadow propagation
+	 * @return The light exposure between 0 and 1
+	 */
+	static float GetLightExposure(const float Collisions);
+
+	/**
+	 * @brief The volume of the intersection of two spheres, negative if the neighbor is fully inside the sphere.
+	 * The spheres are expected to intersect.
+	 */
+	static float CalculateIntersectingVolume(const FSphere& Sphere, const FSphere& Neighbor);
+};
@@ -0,0 +1,71 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A voxel grid used to approximate how much light reaches each point in the simulation.
+ * Bounding spheres are stamped into the grid as occupancy, then shadow is propagated downwards from each occupied
+ * voxel in a pyramid that spreads out and fades the further below it gets, similar to Palubicki et al. 2009.
+ * Building the grid is linear in the number of spheres plus the number of voxels.
+ */
+class FORESTGENERATORCORE_API FShadowGrid
+{
+public:
+	/**
+	 * @brief Rebuilds the grid to cover the given spheres and propagates the shadow.
+	 * @param Spheres The spheres casting shadow
+	 * @param InVoxelSize The width of a voxel, this is increased if the grid would be larger than MaxVoxelsPerAxis
+	 * @param Falloff How much of the shadow is kept per voxel it moves down, between 0 and 1
+	 * @param bForceSingleThread If the shadow should be propagated on the calling thread only
+	 */
+	void Build(const TArray<FSphere>& Spheres, const float InVoxelSize, const float Falloff,
+	           const bool bForceSingleThread = false);
+
+	/**
+	 * @brief Get the shadow cast on a position by everything above it.
+	 * @param Position The world position
+	 * @return The shadow, 0 if nothing is above it and roughly how many full voxels are above it otherwise
+	 */
+	float GetShadow(const FVector& Position) const;
+
+	/**
+	 * @brief The maximum number of voxels along any side of the grid.
+	 */
+	static constexpr int32 MaxVoxelsPerAxis = 256;
+
+private:
+	/**
+	 * @brief Adds a sphere's volume into the voxels whose centers are inside it, or the voxel containing the center
+	 * if the sphere is smaller than a voxel.
+	 */
+	void Stamp(const FSphere& Sphere);
+
+	/**
+	 * @brief Gets the voxel coordinate along an axis, clamped to the grid.
+	 */
+	int32 GetVoxelCoordinate(const float Value, const float OriginValue, const int32 Size) const;
+
+	int32 GetVoxelIndex(const int32 X, const int32 Y, const int32 Z) const;
+
+	FVector Origin = FVector::ZeroVector;
+
+	float VoxelSize = 1.f;
+
+	int32 SizeX = 0;
+
+	int32 SizeY = 0;
+
+	int32 SizeZ = 0;
+
+	/**
+	 * @brief How full each voxel is, as a fraction of the voxel's volume.
+	 */
+	TArray<float> Occupancy;
+
+	/**
+	 * @brief The shadow cast on each voxel by the voxels above it.
+	 */
+	TArray<float> Shadow;
+};
@@ -0,0 +1,50 @@
+// Ollie Nicholls, 2021
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief A list of spheres stored as a structure of arrays so they can be processed four at a time with SIMD.
+ */
+struct FORESTGENERATORCORE_API FSphereBatch
+{
+	TArray<float> CenterX;
+
+	TArray<float> CenterY;
+
+	TArray<float> CenterZ;
+
+	TArray<float> Radius;
+
+	/**
+	 * @brief Removes all spheres while keeping the memory allocated.
+	 * @param NewSize How many spheres to reserve space for
+	 */
+	void Reset(const int32 NewSize = 0);
+
+	/**
+	 * @brief Adds a sphere to the end of the batch.
+	 */
+	void Add(const FSphere& Sphere);
+
+	/**
+	 * @brief Get the number of spheres in the batch.
+	 */
+	int32 Num() const;
+
+	/**
+	 * @brief Get a sphere back out of the batch.
+	 */
+	FSphere Get(const int32 Index) const;
+
+	/**
+	 * @brief Sums the volume of each sphere in the batch that intersects the given sphere. If a sphere in the batch is
+	 * fully inside the given sphere then its whole volume is used.
+	 * This is the same as summing FGrowthModel::CalculateIntersectingVolume over the batch, except the spheres are
+	 * done four at a time. Every sphere in the batch is expected to intersect the given sphere.
+	 * @param Sphere The sphere to test against
+	 * @return The summed intersecting volume
+	 */
+	float SumIntersectingVolumes(const FSphere& Sphere) const;
+};
@@ -0,0 +1,21 @@
+// Ollie Nicholls, 2021
+
+using UnrealBuildTool;
+
+public class ForestGeneratorProgram : ModuleRules
+{
+	public ForestGeneratorProgram(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PublicIncludePaths.Add("Runtime/Launch/Public");
+		PrivateIncludePaths.Add("Runtime/Launch/Private");
+
+		PrivateDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"Core",
+				"Projects",
+				"ForestGeneratorCore",
+			}
+			);
+	}
+}
@@ -0,0 +1,153 @@
+// Ollie Nicholls, 2021
+
+#include "RequiredProgramMainCPPInclude.h"
+
+#include "Misc/FileHelper.h"
+
+#include "BranchModuleTemplate.h"
+#include "GrowthModel.h"
+#include "ForestGeneratorLog.h"
+
+IMPLEMENT_APPLICATION(ForestGeneratorProgram, "ForestGeneratorProgram");
+
+namespace
+{
+	/**
+	 * @brief The growth parameters of a module, the defaults are the same as FPlantSettings.
+	 */
+	struct FProgramSettings
+	{
+		int32 Time = 20;
+		float TimeStep = 1.f;
+		float Vigor = 2.f;
+		int32 Seed = 0;
+		float VMin = 0.5f;
+		float VMax = 2.f;
+		float Gp = 0.12f;
+		float Phi = 1.41f;
+		float Beta = 1.29f;
+		float LMax = 50.f;
+		float G1 = 0.2f;
+		float Alpha = 0.66f;
+		float TropismStrength = 1.f;
+		float Straightness = 1.f;
+	};
+
+	/**
+	 * @brief Parses edges in the form "0-1,1-2,1-3".
+	 */
+	bool ParseEdges(const FString& EdgesString, TArray<TPair<int32, int32>>& OutEdges)
+	{
+		TArray<FString> EdgeStrings;
+		EdgesString.ParseIntoArray(EdgeStrings, TEXT(","));
+
+		for (const FString& EdgeString : EdgeStrings)
+		{
+			FString Source;
+			FString Destination;
+
+			if (!EdgeString.Split(TEXT("-"), &Source, &Destination) || !Source.IsNumeric() || !Destination.IsNumeric())
+			{
+				UE_LOG(LogForestGenerator, Error, TEXT("Program: Invalid edge %s."), *EdgeString);
+				return false;
+			}
+
+			OutEdges.Emplace(FCString::Atoi(*Source), FCString::Atoi(*Destination));
+		}
+
+		return OutEdges.Num() > 0;
+	}
+
+	/**
+	 * @brief Grows a single branch module with a fixed vigor, the same as UBranchModule::Grow for a module that never
+	 * attaches children.
+	 */
+	void GrowModule(const FBranchModuleTemplate& Template, const FProgramSettings& Settings, FBranchGraph& OutGraph)
+	{
+		FRandomStream RandomStream{Settings.Seed};
+
+		OutGraph = Template.Graph;
+
+		for (int32 i = OutGraph.FirstChildBranch[FBranchGraph::RootNode];
+		     i < OutGraph.FirstChildBranch[FBranchGraph::RootNode + 1]; i++)
+		{
+			OutGraph.MakeAvailable(OutGraph.ChildBranches[i]);
+		}
+
+		FGrowthModel::SpawnChildNodes(OutGraph, FBranchGraph::RootNode, 1.f, RandomStream);
+
+		const float Vigor = FMath::Min(Settings.Vigor, Settings.VMax);
+		const float GrowthRate = FGrowthModel::GetGrowthRate(Vigor, Settings.VMin, Settings.VMax, Settings.Gp);
+		float PhysiologicalAge = 0.f;
+
+		for (float SimulatedTime = 0.f; SimulatedTime < Settings.Time; SimulatedTime += Settings.TimeStep)
+		{
+			const float DeltaAge = FGrowthModel::GetDeltaAge(GrowthRate, Settings.TimeStep);
+			PhysiologicalAge += DeltaAge;
+
+			OutGraph.ResolvePositions(false);
+			OutGraph.IncreaseAge(FBranchGraph::RootNode, DeltaAge);
+			FGrowthModel::GrowGraph(OutGraph, PhysiologicalAge, Settings.Straightness, RandomStream);
+			FGrowthModel::GrowBranches(OutGraph, Settings.Phi, Settings.Beta, Settings.LMax, Settings.G1,
+			                           Settings.Alpha, FVector::DownVector, Settings.TropismStrength);
+		}
+	}
+}
+
+INT32_MAIN_INT32_ARGC_TCHAR_ARGV()
+{
+	GEngineLoop.PreInit(ArgC, ArgV);
+
+	const TCHAR* CommandLine = FCommandLine::Get();
+
+	FProgramSettings Settings;
+	FParse::Value(CommandLine, TEXT("Time="), Settings.Time);
+	FParse::Value(CommandLine, TEXT("TimeStep="), Settings.TimeStep);
+	FParse::Value(CommandLine, TEXT("Vigor="), Settings.Vigor);
+	FParse::Value(CommandLine, TEXT("Seed="), Settings.Seed);
+	Settings.TimeStep = FMath::Max(Settings.TimeStep, 1.f);
+
+	FString EdgesString = TEXT("0-1,1-2,1-3,2-4,2-5,3-6,3-7");
+	FParse::Value(CommandLine, TEXT("Edges="), EdgesString);
+
+	TArray<TPair<int32, int32>> Edges;
+	FBranchModuleTemplate Template;
+	int32 ExitCode = 1;
+
+	if (ParseEdges(EdgesString, Edges) && Template.Compile(Edges))
+	{
+		const double StartTime = FPlatformTime::Seconds();
+
+		FBranchGraph Graph;
+		GrowModule(Template, Settings, Graph);
+
+		TArray<FBranchSegment> Segments;
+		Graph.GetBranchTransforms(FBranchGraph::RootNode, Segments);
+
+		UE_LOG(LogForestGenerator, Display, TEXT("Program: Grew %d segments in %f ms."), Segments.Num(),
+		       (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+		FString OutputFilename;
+
+		if (FParse::Value(CommandLine, TEXT("Output="), OutputFilename))
+		{
+			TArray<FString> Lines;
+			Lines.Add(TEXT("StartX,StartY,StartZ,EndX,EndY,EndZ,Diameter"));
+
+			for (const FBranchSegment& Segment : Segments)
+			{
+				Lines.Add(FString::Printf(TEXT("%f,%f,%f,%f,%f,%f,%f"), Segment.Start.X, Segment.Start.Y,
+				                          Segment.Start.Z, Segment.End.X, Segment.End.Y, Segment.End.Z,
+				                          Segment.Diameter));
+			}
+
+			FFileHelper::SaveStringArrayToFile(Lines, *OutputFilename);
+		}
+
+		ExitCode = 0;
+	}
+
+	FEngineLoop::AppPreExit();
+	FEngineLoop::AppExit();
+	return ExitCode;
+}